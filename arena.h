@@ -0,0 +1,149 @@
+#ifndef MCTS_MNK_ARENA_H
+#define MCTS_MNK_ARENA_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+constexpr uint32_t ARENA_FULL = UINT32_MAX;
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+/*
+ * A fixed capacity array of trivially copyable elements that is allocated once with a hard byte budget.
+ * Elements are claimed in consecutive blocks with an atomic bump, so several threads can allocate
+ * at once and nothing ever moves. Once the budget is used up, claims fail instead of growing.
+ */
+template <typename T>
+class Arena {
+
+private:
+    T* elements = nullptr;
+    size_t allocated_bytes = 0;
+    bool mapped = false;
+    bool huge_pages = false;
+
+    uint32_t element_capacity = 0;
+    std::atomic<uint32_t> element_count = 0;
+
+    void release() {
+        if (elements == nullptr) return;
+
+#ifdef __linux__
+        if (mapped) munmap(elements, allocated_bytes);
+        else std::free(elements);
+#else
+        std::free(elements);
+#endif
+
+        elements = nullptr;
+        allocated_bytes = 0;
+        element_capacity = 0;
+        element_count = 0;
+    }
+
+public:
+    Arena() = default;
+    ~Arena() { release(); }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Replaces the current allocation, the old elements are lost
+    void allocate(size_t bytes, bool use_huge_pages) {
+        release();
+        huge_pages = use_huge_pages;
+
+        bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        if (bytes == 0) bytes = HUGE_PAGE_SIZE;
+
+#ifdef __linux__
+        // Pages are only committed once they are touched, the budget is an upper bound
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory != MAP_FAILED) {
+            mapped = true;
+            if (huge_pages) madvise(memory, bytes, MADV_HUGEPAGE);
+        } else {
+            mapped = false;
+            memory = std::aligned_alloc(HUGE_PAGE_SIZE, bytes);
+        }
+#else
+        void* memory = std::aligned_alloc(HUGE_PAGE_SIZE, bytes);
+#endif
+
+        if (memory == nullptr) throw std::bad_alloc();
+
+        elements = static_cast<T*>(memory);
+        allocated_bytes = bytes;
+        element_capacity = static_cast<uint32_t>(std::min<size_t>(bytes / sizeof(T), ARENA_FULL - 1));
+        element_count = 0;
+    }
+
+    // Allocates room for exactly count elements, so that arrays indexed alike have the same capacity
+    void allocate_elements(uint32_t count, bool use_huge_pages) {
+        allocate(static_cast<size_t>(count) * sizeof(T), use_huge_pages);
+        element_capacity = std::min(element_capacity, count);
+    }
+
+    void swap(Arena& other) {
+        std::swap(elements, other.elements);
+        std::swap(allocated_bytes, other.allocated_bytes);
+        std::swap(mapped, other.mapped);
+        std::swap(huge_pages, other.huge_pages);
+        std::swap(element_capacity, other.element_capacity);
+
+        uint32_t count = size();
+        element_count = other.size();
+        other.element_count = count;
+    }
+
+    inline size_t bytes() { return allocated_bytes; }
+    inline bool uses_huge_pages() { return huge_pages; }
+    inline uint32_t size() { return element_count.load(std::memory_order_relaxed); }
+    inline uint32_t capacity() { return element_capacity; }
+    inline bool empty() { return size() == 0; }
+
+    inline T& operator[](size_t index) { return elements[index]; }
+
+    inline void clear() { element_count = 0; }
+
+    // Shrinks the arena to its first count elements
+    inline void truncate(uint32_t count) { element_count = std::min(count, size()); }
+
+    // Claims count consecutive elements and returns the first index, or ARENA_FULL if they don't fit
+    inline uint32_t claim(uint32_t count) {
+        uint32_t start = element_count.load(std::memory_order_relaxed);
+        do {
+            if (static_cast<uint64_t>(start) + count > element_capacity) return ARENA_FULL;
+        } while (!element_count.compare_exchange_weak(start, start + count, std::memory_order_relaxed));
+
+        return start;
+    }
+
+    // Gives back the block of the last claim, a block that other claims followed can't be returned and stays used
+    inline bool unclaim(uint32_t start, uint32_t count) {
+        uint32_t end = start + count;
+        return element_count.compare_exchange_strong(end, start, std::memory_order_relaxed);
+    }
+
+    template <typename... Args>
+    inline uint32_t emplace_back(Args&&... args) {
+        uint32_t index = claim(1);
+        if (index != ARENA_FULL) new (&elements[index]) T(std::forward<Args>(args)...);
+
+        return index;
+    }
+
+    inline uint32_t push_back(const T& element) {
+        return emplace_back(element);
+    }
+};
+
+
+#endif //MCTS_MNK_ARENA_H
@@ -0,0 +1,87 @@
+#ifndef MCTS_MNK_BITBOARD_H
+#define MCTS_MNK_BITBOARD_H
+
+#include <cstdint>
+#include <cstdlib>
+#include "constants.h"
+
+/*
+ * Rows are laid out with one padding column, so a square is stored at bit row * STRIDE + col.
+ * The padding bits are never set, which stops horizontal and diagonal shifts from wrapping into the next row.
+ */
+template <typename Geometry>
+struct Bitboard {
+    static constexpr int STRIDE = Geometry::BOARD_WIDTH + 1;
+    static constexpr int BITS = Geometry::BOARD_HEIGHT * STRIDE;
+    static constexpr int WORDS = (BITS + 63) / 64;
+
+    uint64_t words[WORDS]{};
+
+    static constexpr int get_index(uint16_t row, uint16_t col) {
+        return row * STRIDE + col;
+    }
+
+    static constexpr int get_shift(Increment increment) {
+        int shift = increment.row * STRIDE + increment.col;
+        return shift < 0 ? -shift : shift;
+    }
+
+    inline void set(int index) { words[index >> 6] |= 1ULL << (index & 63); }
+    inline void clear(int index) { words[index >> 6] &= ~(1ULL << (index & 63)); }
+    inline bool test(int index) const { return (words[index >> 6] >> (index & 63)) & 1ULL; }
+
+    inline bool any() const {
+        uint64_t combined = 0;
+        for (uint64_t word : words) combined |= word;
+        return combined != 0;
+    }
+
+    inline int count() const {
+        int bits = 0;
+        for (uint64_t word : words) bits += __builtin_popcountll(word);
+        return bits;
+    }
+
+    inline Bitboard operator&(const Bitboard& other) const {
+        Bitboard result;
+        for (int i = 0; i < WORDS; i++) result.words[i] = words[i] & other.words[i];
+        return result;
+    }
+
+    inline Bitboard operator|(const Bitboard& other) const {
+        Bitboard result;
+        for (int i = 0; i < WORDS; i++) result.words[i] = words[i] | other.words[i];
+        return result;
+    }
+
+    // Moves every bit towards index 0, bits shifted in from the top are zero.
+    inline Bitboard operator>>(int shift) const {
+        Bitboard result;
+        int word_shift = shift >> 6;
+        int bit_shift = shift & 63;
+
+        for (int i = 0; i + word_shift < WORDS; i++) {
+            uint64_t low = words[i + word_shift] >> bit_shift;
+            uint64_t high = (bit_shift != 0 && i + word_shift + 1 < WORDS) ?
+                            words[i + word_shift + 1] << (64 - bit_shift) : 0;
+            result.words[i] = low | high;
+        }
+
+        return result;
+    }
+
+    // Returns true if the bitboard contains WIN_AMT set bits in a row along the given direction
+    inline bool has_line(Increment increment) const {
+        int shift = get_shift(increment);
+
+        Bitboard run = *this;
+        for (int i = 1; i < Geometry::WIN_AMT; i++) {
+            run = run & (run >> shift);
+        }
+
+        return run.any();
+    }
+};
+
+
+#endif //MCTS_MNK_BITBOARD_H
@@ -17,20 +17,44 @@ constexpr uint64_t MAX_ITERATIONS = 10000000;
 constexpr uint64_t MAX_TIME = 5000;
 constexpr double EXPLORATION_CONSTANT = 1.41;
 
-constexpr int BOARD_HEIGHT = 15;
-constexpr int BOARD_WIDTH = 15;
-constexpr int WIN_AMT = 5;
-constexpr int THREADS = 1;
-constexpr int MAX_MOVES = BOARD_HEIGHT * BOARD_WIDTH;
+constexpr int DEFAULT_THREADS = 1;
+constexpr uint64_t DEFAULT_SEED = 1;
 
-constexpr PLY_TYPE MAX_SIMULATION_DEPTH = WIN_AMT * WIN_AMT + 9;
-constexpr PLY_TYPE MAX_DEPTH = MAX_SIMULATION_DEPTH + 256;
+constexpr int LEAF_PARALLEL = 0;  // One thread walks the tree, every thread plays a rollout from its leaf
+constexpr int TREE_PARALLEL = 1;  // Every thread runs whole iterations on the shared tree
+constexpr int ROOT_PARALLEL = 2;  // Every thread searches its own tree, the root statistics are merged
+
+constexpr int VIRTUAL_LOSS = 3;
+
+constexpr int FULL_EXPANSION = 0;        // Every legal move becomes a child when a node is expanded
+constexpr int PROGRESSIVE_WIDENING = 1;  // Only the best moves by prior are children, more are added as visits grow
+
+// A node with n visits exposes its ceil(WIDENING_CONSTANT * sqrt(n)) best children to selection
+constexpr double WIDENING_CONSTANT = 2.0;
+
+constexpr int SOLVER_OFF = 0;  // Leaves are only judged by rollouts
+constexpr int SOLVER_VCF = 1;  // New leaves are searched for a win by continuous fours
+constexpr int SOLVER_VCT = 2;  // New leaves are searched for a win by continuous fours and threes
+
+// The solver's depth counts the attacker's moves, a leaf search also gives up after LEAF_SOLVER_NODES nodes
+constexpr int MAX_SOLVER_DEPTH = 16;
+constexpr int LEAF_SOLVER_DEPTH = 6;
+constexpr uint64_t LEAF_SOLVER_NODES = 256;
+constexpr uint64_t MAX_SOLVER_NODES = 10000000;
+
+// A rollout depth that plays every rollout until the game ends, any other depth scores the position it stops at
+constexpr int FULL_ROLLOUTS = 0;
+
+// What a won iteration adds to the win count of the winner's nodes, an evaluated one adds a share of it
+constexpr int RESULT_UNITS = 64;
+
+constexpr size_t DEFAULT_TREE_MEMORY_MB = 512;
+constexpr size_t EDGE_MEMORY_PERCENT = 80;  // Share of the tree memory for edges outside of tree parallel searches
 
 constexpr int WHITE  = 0;
 constexpr int BLACK  = 1;
 constexpr int EMPTY  = 2;
 constexpr int VISUAL = 3;
-constexpr int ADJACENT = 4;
 
 constexpr int DRAW_SCORE = 2;
 constexpr int NO_SCORE = 3;
@@ -49,7 +73,32 @@ struct Move {
     uint16_t col = 0;
 };
 
-constexpr Move NO_MOVE = {BOARD_HEIGHT, BOARD_WIDTH};
+/*
+ * The board of an (m, n, k) game. Position, MCTS and PerftEngine are compiled for every geometry below, so the board
+ * dimensions stay compile time constants in the hot loops while main picks the geometry at runtime.
+ */
+template <int height, int width, int win_amt>
+struct Geometry {
+    static constexpr int BOARD_HEIGHT = height;
+    static constexpr int BOARD_WIDTH = width;
+    static constexpr int WIN_AMT = win_amt;
+    static constexpr int MAX_MOVES = height * width;
+
+    static constexpr PLY_TYPE MAX_SIMULATION_DEPTH = win_amt * win_amt + 9;
+    static constexpr PLY_TYPE MAX_DEPTH = MAX_MOVES + 1;  // A game can't last longer than the board has squares
+
+    static constexpr Move NO_MOVE = {height, width};
+
+    // Square boards have all eight rotations and reflections, the others only keep their shape under four
+    static constexpr int SYMMETRIES = height == width ? 8 : 4;
+};
+
+using TicTacToe   = Geometry<3, 3, 3>;
+using ConnectFour = Geometry<6, 7, 4>;
+using Gomoku      = Geometry<15, 15, 5>;
+using Gomoku19    = Geometry<19, 19, 5>;
+
+using DefaultGeometry = Gomoku;
 
 namespace std {
     template <>
@@ -60,7 +109,7 @@ namespace std {
     };
 }
 
-inline bool operator==(const Move& move1, const Move& move2) {
+constexpr bool operator==(const Move& move1, const Move& move2) {
     return move1.row == move2.row && move1.col == move2.col;
 }
 
@@ -97,12 +146,5 @@ inline std::vector<std::string> split(const std::string &s, char delim) {
     return elems;
 }
 
-inline int get_chebyshev_distance(Move move_1, Move move_2) {
-    if (move_1.row == BOARD_HEIGHT || move_2.row == BOARD_HEIGHT) return 0;
-
-    return std::max(abs(static_cast<int>(move_1.row) - static_cast<int>(move_2.row)),
-                    abs(static_cast<int>(move_1.col) - static_cast<int>(move_2.col)));
-}
-
 
 #endif //MCTS_MNK_CONSTANTS_H
@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <cstring>
 #include <array>
+#include <algorithm>
 
 template <typename T, size_t FixedSize>
 class FixedVector {
@@ -19,6 +20,15 @@ private:
 public:
     FixedVector() = default;
 
+    // Only the used prefix is copied, large stacks are cheap to copy while they are mostly empty
+    FixedVector(const FixedVector& other) { *this = other; }
+
+    FixedVector& operator=(const FixedVector& other) {
+        current_index = other.current_index;
+        std::copy(other.fixed_vector.begin(), other.fixed_vector.begin() + current_index, fixed_vector.begin());
+        return *this;
+    }
+
     inline size_t size() { return current_index; }
     inline bool empty() { return current_index == 0; }
 
@@ -30,6 +40,8 @@ public:
 
     inline void clear() { current_index = 0; }
 
+    inline T& back() { return fixed_vector[current_index - 1]; }
+
     inline void push_back(T element) {
         fixed_vector[current_index] = element;
         current_index++;
@@ -1,12 +1,76 @@
 #include <iostream>
 #include "mcts.h"
 #include "perft.h"
+#include "negamax.h"
 
 
-int main() {
-    MCTS mcts{};
-    PerftEngine perft_engine{};
-    mcts.tree.graph.emplace_back(0, NO_MOVE);
+// The search settings that carry over to the next game when the board changes
+struct Settings {
+    int threads = DEFAULT_THREADS;
+    int search_mode = LEAF_PARALLEL;
+    int expansion_mode = FULL_EXPANSION;
+    bool transpositions = true;
+    int solver_mode = SOLVER_OFF;
+    int rollout_depth = FULL_ROLLOUTS;
+    uint64_t seed = DEFAULT_SEED;
+    size_t tree_memory = DEFAULT_TREE_MEMORY_MB * 1024 * 1024;
+    bool huge_pages = false;
+    std::string network_path{};  // Empty while the search uses rollouts
+};
+
+// The geometry a new game is played on, height 0 when the board doesn't change
+struct BoardRequest {
+    int height = 0;
+    int width = 0;
+    int win_amt = 0;
+};
+
+template <typename Geometry>
+constexpr bool is_geometry(const BoardRequest& board) {
+    return board.height == Geometry::BOARD_HEIGHT && board.width == Geometry::BOARD_WIDTH &&
+           board.win_amt == Geometry::WIN_AMT;
+}
+
+inline bool is_supported_board(const BoardRequest& board) {
+    return is_geometry<TicTacToe>(board) || is_geometry<ConnectFour>(board) ||
+           is_geometry<Gomoku>(board) || is_geometry<Gomoku19>(board);
+}
+
+void print_supported_boards() {
+    std::cout << "Supported boards (height width win): 3 3 3, 6 7 4, 15 15 5, 19 19 5" << std::endl;
+}
+
+// Loads the network of the settings for the geometry, the position's accumulator is rebuilt for it
+template <typename Geometry>
+void load_network(Settings& settings, MCTS<Geometry>& mcts) {
+    if (NETWORK<Geometry>.load(settings.network_path)) {
+        std::cout << "network loaded from " << settings.network_path
+                  << " (" << get_nnue_kernel_name() << " kernels)" << std::endl;
+    } else {
+        std::cout << "no network for this board in " << settings.network_path << ", using rollouts" << std::endl;
+    }
+
+    mcts.position.refresh_accumulator();
+}
+
+// Plays one game on the given geometry, returns the board of the next game or height 0 to quit
+template <typename Geometry>
+BoardRequest play(Settings& settings) {
+    MCTS<Geometry> mcts{};
+    PerftEngine<Geometry> perft_engine{};
+    Engine<Geometry> engine{};
+    FixedVector<Move, Geometry::MAX_MOVES> moves{};
+
+    mcts.set_tree_memory(settings.tree_memory, settings.huge_pages);
+    mcts.set_seed(settings.seed);
+    mcts.set_threads(settings.threads);
+    mcts.set_search_mode(settings.search_mode);
+    mcts.expansion_mode = settings.expansion_mode;
+    mcts.transpositions = settings.transpositions;
+    mcts.solver_mode = settings.solver_mode;
+    mcts.rollout_depth = settings.rollout_depth;
+    mcts.tree.emplace_back(0, Geometry::NO_MOVE);
+    if (!settings.network_path.empty()) load_network(settings, mcts);
 
     mcts.position.print_board();
 
@@ -14,11 +78,35 @@ int main() {
     while (getline(std::cin, msg)) {
 
         std::vector <std::string> tokens = split(msg, ' ');
+        if (tokens.empty()) continue;
+
+        if (tokens[0] == "set" && tokens.size() >= 5 && tokens[1] == "board") {
+            BoardRequest board{std::stoi(tokens[2]), std::stoi(tokens[3]), std::stoi(tokens[4])};
+            if (is_supported_board(board)) return board;
+
+            std::cout << "unsupported board " << tokens[2] << " " << tokens[3] << " " << tokens[4] << std::endl;
+            print_supported_boards();
+            continue;
+        }
 
         if (tokens[0] == "perft") {
             std::cout << perft_engine.perft(mcts.position, 4);
         }
 
+        if (tokens[0] == "solve") {
+            engine.mode = mcts.solver_mode == SOLVER_VCF ? SOLVER_VCF : SOLVER_VCT;
+            int depth = tokens.size() >= 2 ? std::stoi(tokens[1]) : MAX_SOLVER_DEPTH;
+            int result = engine.solve(mcts.position, depth, MAX_SOLVER_NODES);
+
+            std::cout << (engine.mode == SOLVER_VCF ? "VCF" : "VCT") << " depth " << engine.completed_depth
+                      << " nodes " << engine.nodes << ": ";
+            if (result == NO_SCORE) std::cout << "no forced win found" << std::endl;
+            else if (result == mcts.position.side) {
+                std::cout << "win with [" << CYAN << engine.best_move.row << ", " << engine.best_move.col << RESET
+                          << "]" << std::endl;
+            } else std::cout << "loss" << std::endl;
+        }
+
         if (tokens[0] == "go") {
             auto time = std::chrono::high_resolution_clock::now();
             uint64_t current_time = std::chrono::duration_cast<std::chrono::milliseconds>
@@ -28,7 +116,9 @@ int main() {
             uint64_t best_node_index = mcts.search();
             Node& best_node = mcts.tree.graph[best_node_index];
 
-            double win_probability = mcts.get_win_probability(best_node_index);
+            // Root parallel searches report the votes of every tree for the move
+            MoveStatistics statistics = mcts.get_move_statistics(best_node_index);
+            double win_probability = mcts.get_win_probability(statistics.win_count, statistics.visits);
 
             std::string win_probability_color = win_probability >  30 ? GREEN :
                                                 win_probability < -30 ? RED   :
@@ -42,20 +132,28 @@ int main() {
 
             std::cout << std::endl
                       << "Total Iterations: \t" << CYAN << mcts.iterations << RESET << "\n"
-                      << "Score: \t\t\t\t"      << CYAN << best_node.win_count << RESET << "\n"
-                      << "Visits: \t\t\t"       << CYAN << best_node.visits << RESET << "\n"
+                      << "Score: \t\t\t\t"      << CYAN << static_cast<double>(statistics.win_count) / RESULT_UNITS << RESET << "\n"
+                      << "Visits: \t\t\t"       << CYAN << statistics.visits << RESET << "\n"
                       << "Confidence: \t\t"     << win_probability_color << win_probability << "%\n" << RESET
                       << "Seldepth: \t\t\t"     << CYAN << mcts.seldepth << RESET << "\n"
                       << "Time: \t\t\t\t"       << CYAN << elapsed_time << RESET << "\n"
-                      << "IPS: \t\t\t\t"        << CYAN << mcts.iterations / (elapsed_time / 1000) << RESET
-                      << std::endl << std::endl;
+                      << "IPS: \t\t\t\t"        << CYAN << mcts.iterations * 1000 / std::max<uint64_t>(elapsed_time, 1)
+                      << RESET << std::endl << std::endl;
+
+            int proven_result = statistics.proven_result;
+            if (proven_result != NO_SCORE) {
+                std::cout << "Proven: \t\t\t" << CYAN
+                          << (proven_result == DRAW_SCORE ? "draw" :
+                              proven_result == mcts.position.side ? "win" : "loss")
+                          << RESET << std::endl << std::endl;
+            }
 
             Move best_move = best_node.last_move;
 
             std::cout << "best move [" << CYAN << best_move.row << ", " << best_move.col << RESET << "]"
                       << std::endl << std::endl;
 
-            mcts.position.make_move<MOVE_ADJACENCY>(best_move);
+            mcts.position.template make_move<MOVE_ADJACENCY>(best_move);
             mcts.position.print_board();
 
             mcts.root_node_index = best_node_index;
@@ -66,24 +164,25 @@ int main() {
         if (tokens[0] == "move") {
             Move sent_move = Move{static_cast<uint16_t>(std::stoi(tokens[1])),
                                   static_cast<uint16_t>(std::stoi(tokens[2]))};
-            mcts.position.make_move<MOVE_ADJACENCY>(sent_move);
+            mcts.position.template make_move<MOVE_ADJACENCY>(sent_move);
             std::cout << std::endl;
 
             mcts.position.print_board();
 
             int node_index = -1;
-            for (int i = 0; i < mcts.tree.graph[mcts.root_node_index].children_end - mcts.tree.graph[mcts.root_node_index].children_start; i++) {
+            for (uint32_t i = 0; i < mcts.tree.graph[mcts.root_node_index].children_end - mcts.tree.graph[mcts.root_node_index].children_start; i++) {
                 Move& match_move = mcts.tree.graph[mcts.tree.graph[mcts.root_node_index].children_start + i].last_move;
                 if (sent_move.col == match_move.col && sent_move.row == match_move.row) {
-                    node_index = i;
+                    node_index = static_cast<int>(i);
                     break;
                 }
             }
 
+            // Nothing of the old tree can be reused when the move was never expanded
             if (node_index == -1) {
-                mcts.tree.graph.emplace_back(mcts.root_node_index, sent_move);
-                mcts.tree.graph[mcts.root_node_index].children_end = mcts.tree.graph.size();
-                mcts.root_node_index = mcts.tree.graph.size() - 1;
+                mcts.tree.clear();
+                mcts.tree.emplace_back(0, sent_move);
+                mcts.root_node_index = 0;
             } else {
                 mcts.root_node_index = mcts.tree.graph[mcts.root_node_index].children_start + node_index;
             }
@@ -91,23 +190,136 @@ int main() {
             mcts.flatten_tree();
         }
 
+        if (tokens[0] == "set" && tokens.size() >= 3) {
+            if (tokens[1] == "threads") {
+                settings.threads = std::max(1, std::stoi(tokens[2]));
+                mcts.set_threads(settings.threads);
+                std::cout << "threads set to " << mcts.thread_pool.size() << std::endl;
+            }
+
+            if (tokens[1] == "mode") {
+                bool known = tokens[2] == "leaf" || tokens[2] == "tree" || tokens[2] == "root";
+                if (tokens[2] == "leaf") mcts.set_search_mode(LEAF_PARALLEL);
+                if (tokens[2] == "tree") mcts.set_search_mode(TREE_PARALLEL);
+                if (tokens[2] == "root") mcts.set_search_mode(ROOT_PARALLEL);
+                settings.search_mode = mcts.search_mode;
+
+                std::string mode_name = mcts.search_mode == LEAF_PARALLEL ? "leaf" :
+                                        mcts.search_mode == TREE_PARALLEL ? "tree" : "root";
+                if (known) std::cout << "mode set to " << mode_name << std::endl;
+                else std::cout << "unknown mode " << tokens[2] << ", expected leaf, tree or root, mode is still "
+                               << mode_name << std::endl;
+            }
+
+            if (tokens[1] == "widening") {
+                mcts.expansion_mode = tokens[2] == "on" ? PROGRESSIVE_WIDENING : FULL_EXPANSION;
+                settings.expansion_mode = mcts.expansion_mode;
+                std::cout << "progressive widening " << (tokens[2] == "on" ? "on" : "off") << std::endl;
+            }
+
+            if (tokens[1] == "transpositions") {
+                mcts.transpositions = tokens[2] == "on";
+                settings.transpositions = mcts.transpositions;
+                std::cout << "transpositions " << (mcts.transpositions ? "on" : "off") << std::endl;
+            }
+
+            if (tokens[1] == "solver") {
+                mcts.solver_mode = tokens[2] == "vcf" ? SOLVER_VCF : tokens[2] == "vct" ? SOLVER_VCT : SOLVER_OFF;
+                settings.solver_mode = mcts.solver_mode;
+                std::cout << "leaf solver " << (mcts.solver_mode == SOLVER_VCF ? "vcf" :
+                                                mcts.solver_mode == SOLVER_VCT ? "vct" : "off") << std::endl;
+            }
+
+            if (tokens[1] == "rollout") {
+                mcts.rollout_depth = std::max(0, std::stoi(tokens[2]));
+                settings.rollout_depth = mcts.rollout_depth;
+                if (mcts.rollout_depth == FULL_ROLLOUTS) std::cout << "rollouts played to the end" << std::endl;
+                else std::cout << "rollouts evaluated after " << mcts.rollout_depth << " plies" << std::endl;
+            }
+
+            if (tokens[1] == "network") {
+                if (tokens[2] == "off") {
+                    NETWORK<Geometry>.unload();
+                    settings.network_path.clear();
+                    std::cout << "network off" << std::endl;
+                } else {
+                    settings.network_path = tokens[2];
+                    load_network(settings, mcts);
+                }
+            }
+
+            if (tokens[1] == "seed") {
+                mcts.set_seed(std::stoull(tokens[2]));
+                settings.seed = mcts.seed;
+                std::cout << "seed set to " << mcts.seed << std::endl;
+            }
+
+            if (tokens[1] == "memory") {
+                mcts.set_tree_memory(std::max(1, std::stoi(tokens[2])) * 1024ULL * 1024ULL, mcts.huge_pages);
+                settings.tree_memory = mcts.tree_memory;
+                std::cout << "tree memory set to " << tokens[2] << " MB" << std::endl;
+            }
+
+            if (tokens[1] == "hugepages") {
+                mcts.set_tree_memory(mcts.tree_memory, tokens[2] == "on");
+                settings.huge_pages = mcts.huge_pages;
+                std::cout << "huge pages " << (mcts.huge_pages ? "on" : "off") << std::endl;
+            }
+        }
+
         if (tokens[0] == "help") {
             std::cout << "Type go for the MCTS engine to make a move\n";
             std::cout << "Type move {row} {col} to make a move\n";
+            std::cout << "Type set threads {n} to change the number of search threads\n";
+            std::cout << "Type set mode {leaf|tree|root} to choose between leaf, tree and root parallel search\n";
+            std::cout << "Type set widening {on|off} to only expand the best moves by prior, widening with visits\n";
+            std::cout << "Type set transpositions {on|off} to share the children of positions reached by several move orders\n";
+            std::cout << "Type set solver {off|vcf|vct} to search new leaves for wins by continuous fours or threats\n";
+            std::cout << "Type set rollout {plies} to score rollouts with the static evaluator after that many plies, 0 plays them out\n";
+            std::cout << "Type set network {file|off} to evaluate leaves and take priors from a network instead of rollouts\n";
+            std::cout << "Type solve [depth] to search the position for a forced win by threats\n";
+            std::cout << "Type set seed {n} to restart the random number generators from a fixed seed\n";
+            std::cout << "Type set memory {MB} to change the memory budget of the search tree\n";
+            std::cout << "Type set hugepages {on|off} to back the search tree with huge pages\n";
+            std::cout << "Type set board {height} {width} {win} to start a new game on another board\n";
+            std::cout << "Selection uses the " << get_puct_kernel_name() << " PUCT kernel\n";
         }
 
         int result = mcts.position.get_result(mcts.tree.graph[mcts.root_node_index].last_move);
         if (result != NO_SCORE) {
             std::cout << "Result: " << result << std::endl;
-            break;
+            return BoardRequest{};
         }
 
-        mcts.position.get_moves(mcts.move_vectors[0]);
-        if (mcts.move_vectors[0].empty()) {
+        mcts.position.get_moves(moves);
+        if (moves.empty()) {
             std::cout << "DRAW" << std::endl;
-            break;
+            return BoardRequest{};
         }
     }
 
+    return BoardRequest{};
+}
+
+int main(int argc, char* argv[]) {
+    BoardRequest board{DefaultGeometry::BOARD_HEIGHT, DefaultGeometry::BOARD_WIDTH, DefaultGeometry::WIN_AMT};
+    if (argc >= 4) board = BoardRequest{std::stoi(argv[1]), std::stoi(argv[2]), std::stoi(argv[3])};
+
+    if (!is_supported_board(board)) {
+        std::cout << "unsupported board " << board.height << " " << board.width << " " << board.win_amt << std::endl;
+        print_supported_boards();
+        return 1;
+    }
+
+    Settings settings{};
+    if (argc >= 5) settings.network_path = argv[4];
+
+    while (board.height) {
+        if (is_geometry<TicTacToe>(board)) board = play<TicTacToe>(settings);
+        else if (is_geometry<ConnectFour>(board)) board = play<ConnectFour>(settings);
+        else if (is_geometry<Gomoku>(board)) board = play<Gomoku>(settings);
+        else board = play<Gomoku19>(settings);
+    }
+
     return 0;
 }
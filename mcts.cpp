@@ -4,13 +4,114 @@
 
 #include <iostream>
 #include <cmath>
-#include <queue>
+#include <chrono>
+#include <limits>
 #include "mcts.h"
 
 
+template <typename Geometry>
+void MCTS<Geometry>::set_threads(int threads) {
+    thread_pool.resize(threads);
+    search_threads.resize(threads);
+    allocate_trees();
+    set_seed(seed);
+}
+
+// Restarts the random streams of every thread, thread i draws from its own stream of the seed
+template <typename Geometry>
+void MCTS<Geometry>::set_seed(uint64_t new_seed) {
+    seed = new_seed;
+
+    for (size_t thread_id = 0; thread_id < search_threads.size(); thread_id++) {
+        search_threads[thread_id].random.seed(get_stream_seed(seed, thread_id));
+    }
+
+    // Root parallel helpers search with their own seed, derived from the helper's thread id
+    for (size_t helper = 0; helper < root_searchers.size(); helper++) {
+        root_searchers[helper]->set_seed(get_stream_seed(~seed, helper + 1));
+    }
+}
+
+/*
+ * The other modes leave nodes with only some of their children, and add_child moves such blocks while tree parallel
+ * threads could be inside them. A tree parallel search therefore starts again from the root of such a tree.
+ */
+template <typename Geometry>
+void MCTS<Geometry>::set_search_mode(int mode) {
+    bool partial_children = search_mode != TREE_PARALLEL && mode == TREE_PARALLEL;
+    search_mode = mode;
+    allocate_trees();
+
+    if (partial_children && !tree.graph.empty()) {
+        Move root_move = tree.graph[root_node_index].last_move;
+        tree.clear();
+        tree.emplace_back(0, root_move);
+        root_node_index = 0;
+    }
+}
+
+template <typename Geometry>
+void MCTS<Geometry>::set_tree_memory(size_t bytes, bool use_huge_pages) {
+    tree_memory = bytes;
+    huge_pages = use_huge_pages;
+    allocate_trees();
+}
+
+// In root parallel searches every thread's tree gets an equal share of the budget
+template <typename Geometry>
+size_t MCTS<Geometry>::get_tree_bytes() {
+    return search_mode == ROOT_PARALLEL ? tree_memory / thread_pool.size() : tree_memory;
+}
+
+// Tree parallel searches create a node for every edge, the other modes only for the edges that get selected
+template <typename Geometry>
+size_t MCTS<Geometry>::get_edge_bytes() {
+    if (search_mode == TREE_PARALLEL) return get_tree_bytes() / (Tree::NODE_BYTES + Tree::EDGE_BYTES) * Tree::EDGE_BYTES;
+    return get_tree_bytes() / 100 * EDGE_MEMORY_PERCENT;
+}
 
-double MCTS::get_win_probability(uint32_t node_index) {
-    double win_ratio = static_cast<double>(tree.graph[node_index].win_count) / tree.graph[node_index].visits;
+template <typename Geometry>
+void MCTS<Geometry>::allocate_trees() {
+    size_t node_bytes = get_tree_bytes() - get_edge_bytes();
+    size_t edge_bytes = get_edge_bytes();
+
+    if (tree.graph.capacity() == Tree::get_node_capacity(node_bytes)
+        && tree.edges.capacity() == Tree::get_edge_capacity(edge_bytes)
+        && tree.graph.uses_huge_pages() == huge_pages) return;
+
+    // Keep the tree if it still fits, otherwise start again from the root
+    Tree old_tree{};
+    tree.swap(old_tree);
+    tree.allocate(node_bytes, edge_bytes, huge_pages);
+
+    if (!old_tree.graph.empty() && old_tree.graph.size() <= tree.graph.capacity()
+        && old_tree.edges.size() <= tree.edges.capacity()) {
+        for (uint32_t node_index = 0; node_index < old_tree.graph.size(); node_index++) {
+            tree.graph.push_back(old_tree.graph[node_index]);
+            tree.visits[node_index] = old_tree.visits[node_index];
+            tree.win_counts[node_index] = old_tree.win_counts[node_index];
+            tree.proofs[node_index] = old_tree.proofs[node_index];
+            tree.hash_keys[node_index] = old_tree.hash_keys[node_index];
+            tree.symmetries[node_index] = old_tree.symmetries[node_index];
+        }
+
+        for (uint32_t edge_index = 0; edge_index < old_tree.edges.size(); edge_index++) {
+            tree.edges.push_back(old_tree.edges[edge_index]);
+            tree.priors[edge_index] = old_tree.priors[edge_index];
+        }
+
+        rebuild_transpositions();
+    } else if (!old_tree.graph.empty()) {
+        tree.emplace_back(0, old_tree.graph[root_node_index].last_move);
+        root_node_index = 0;
+    }
+
+    root_searchers.clear();
+}
+
+template <typename Geometry>
+double MCTS<Geometry>::get_win_probability(int win_count, int visits) {
+    double win_ratio = static_cast<double>(win_count) / (static_cast<double>(visits) * RESULT_UNITS);
     int win_side = (win_ratio > 0) - (win_ratio < 0);
 
     win_ratio = win_side * (std::pow(abs(win_ratio) + 0.03, 0.71) - 0.1 + 0.2 * abs(win_ratio));
@@ -19,16 +120,50 @@ double MCTS::get_win_probability(uint32_t node_index) {
     return win_probability;
 }
 
-void MCTS::descend_to_root(uint32_t node_index) {
-    while (node_index != root_node_index && ply > 0) {
-        ply--;
-        position.undo_move<MOVE_ADJACENCY>(tree.graph[node_index].last_move);
-        node_index = tree.graph[node_index].parent;
+template <typename Geometry>
+double MCTS<Geometry>::get_win_probability(uint32_t node_index) {
+    return get_win_probability(tree.get_win_count(node_index), tree.get_visits(node_index));
+}
+
+template <typename Geometry>
+void MCTS<Geometry>::descend_to_root(SearchThread<Geometry>& thread) {
+    while (thread.ply > 0) {
+        thread.ply--;
+        thread.position.template undo_move<MOVE_ADJACENCY>(thread.state_stack[thread.ply].move);
     }
 
     // position.print_board();
 }
 
+template <typename Geometry>
+int MCTS<Geometry>::make_tree_move(SearchThread<Geometry>& thread, uint32_t node_index) {
+    Node& node = tree.graph[node_index];
+
+    // Make the node look like a loss until it is back propagated so other threads spread out
+    if (virtual_loss) tree.add_statistics(node_index, virtual_loss, -virtual_loss * RESULT_UNITS);
+
+    Move move = transform_move<Geometry>(node.last_move, thread.orientation);
+    int result = thread.position.template make_move_get_result<MOVE_ADJACENCY>(move);
+    thread.state_stack[thread.ply].move = move;
+    thread.ply++;
+    thread.path[thread.ply] = PathNode{node_index, node_index};
+
+    return result;
+}
+
+// The node whose children are searched from the thread's current node, which differs for transpositions
+template <typename Geometry>
+uint32_t MCTS<Geometry>::resolve_transposition(SearchThread<Geometry>& thread, uint32_t node_index) {
+    uint32_t children_node_index = node_index;
+    if (tree.graph[node_index].is_transposition()) {
+        children_node_index = tree.find_transposition(tree.hash_keys[node_index]);
+        thread.orientation = combine_symmetries(thread.orientation, tree.symmetries[node_index]);
+    }
+
+    thread.path[thread.ply] = PathNode{node_index, children_node_index};
+    return children_node_index;
+}
+
 /*
  * UCT FORMULA
 double exploitation_value = double(child_node.win_count) / child_node.visits;
@@ -39,190 +174,446 @@ double uct_value = exploitation_value + EXPLORATION_CONSTANT * exploration_value
 
 */
 
-uint32_t MCTS::select_best_child(uint32_t node_index) {
+/*
+ * The prior of a move is read off the line patterns of its square: what it makes for the side to move and what it
+ * takes away from the opponent along each line, and how close both sides' stones on those lines are.
+ */
+constexpr double ATTACK_WEIGHTS[PATTERN_CLASSES]  = {0, 0, 2, 8, 30, 40, 150, 1500};
+constexpr double DEFENCE_WEIGHTS[PATTERN_CLASSES] = {0, 0, 1, 5, 20, 30, 80, 800};
+constexpr double PROXIMITY_WEIGHT = 4;
+
+template <typename Geometry>
+double MCTS<Geometry>::get_policy(Position<Geometry>& position, Move move) {
+    int our_side = position.side;
+    int opp_side = position.side ^ 1;
+
+    double policy = 1.0;
+    for (int direction = 0; direction < 4; direction++) {
+        policy += ATTACK_WEIGHTS[position.get_pattern(our_side, direction, move.row, move.col)] +
+                  DEFENCE_WEIGHTS[position.get_pattern(opp_side, direction, move.row, move.col)] +
+                  PROXIMITY_WEIGHT * (position.get_proximity(our_side, direction, move.row, move.col) +
+                                      position.get_proximity(opp_side, direction, move.row, move.col));
+    }
 
-    Node node = tree.graph[node_index];
+    return policy;
+}
 
-    uint32_t n_children = tree.graph[node_index].children_end - tree.graph[node_index].children_start;
+/*
+ * The static evaluation of a truncated rollout, or of any leaf once a network is loaded, for the side to move in
+ * RESULT_UNITS. Without a network every empty square adds the patterns a stone there would make for the side to move
+ * and takes away the ones it would make for the opponent, who has to answer them first. The sum is mapped to a win
+ * probability by a logistic curve. The weights and the scale are hand tuned for 15x15 boards with five in a row, the
+ * sum grows with the number of squares, so the scale shrinks with the board.
+ */
+constexpr double EVALUATION_OWN_WEIGHTS[PATTERN_CLASSES] = {0, 0, 0, 1, 1, 14, 150, 0};
+constexpr double EVALUATION_OPP_WEIGHTS[PATTERN_CLASSES] = {0, 0, 0, 1, 1, 10, 21, 78};
+constexpr double EVALUATION_SCALE = 75;
+
+template <typename Geometry>
+int MCTS<Geometry>::evaluate(Position<Geometry>& position) {
+    Threats<Geometry>& threats = position.threats;
+    int our_side = position.side;
+    int opp_side = position.side ^ 1;
+
+    // A five on the spot wins and two fives of the opponent can't both be blocked
+    if (!threats.threats_1[our_side].empty()) return RESULT_UNITS;
+    if (threats.threats_1[opp_side].size() >= 2) return -RESULT_UNITS;
+
+    Network<Geometry>& network = NETWORK<Geometry>;
+    if (network.loaded) {
+        alignas(32) std::array<uint8_t, Network<Geometry>::HEAD_INPUTS> activations{};
+        network.get_activations(position.accumulator, our_side, activations.data());
+        return network.get_value(activations.data());
+    }
 
-    std::vector<double> policies(n_children);
-    position.get_threats(current_threats);
+    double score = 0;
+    for (uint16_t row = 0; row < BOARD_HEIGHT; row++) {
+        for (uint16_t col = 0; col < BOARD_WIDTH; col++) {
+            if (!position.is_empty(row, col)) continue;
 
-    double max_policy = 0;
-    for (int i = 0; i < n_children; i++) {
-        uint32_t child_node_index = tree.graph[node_index].children_start + i;
-        Node child_node = tree.graph[child_node_index];
+            for (int direction = 0; direction < 4; direction++) {
+                score += EVALUATION_OWN_WEIGHTS[position.get_pattern(our_side, direction, row, col)] -
+                         EVALUATION_OPP_WEIGHTS[position.get_pattern(opp_side, direction, row, col)];
+            }
+        }
+    }
 
-        double policy;
+    constexpr double scale = EVALUATION_SCALE * MAX_MOVES / Gomoku::MAX_MOVES;
+    double win_probability = 1.0 / (1.0 + std::exp(-score / scale));
+    return static_cast<int>(std::lround((2.0 * win_probability - 1.0) * RESULT_UNITS));
+}
 
-        int distance_range = WIN_AMT - 1;
+// The value of a decided game for white
+template <typename Geometry>
+int MCTS<Geometry>::get_result_value(int result) {
+    return result == WHITE ? RESULT_UNITS : result == BLACK ? -RESULT_UNITS : 0;
+}
 
-        double best_distance = std::max(BOARD_WIDTH, BOARD_HEIGHT) + 2;
-        int near_stones = 0;
+/*
+ * Generates the moves of the position with their priors, best first. When the position has a win on the spot only
+ * the winning move is generated, and when the opponent has one only the blocks are. Returns the result of the
+ * position when this already decides it, a win or two fours that can't both be blocked, and NO_SCORE otherwise.
+ */
+template <typename Geometry>
+int MCTS<Geometry>::generate_children(SearchThread<Geometry>& thread) {
+    Threats<Geometry>& threats = thread.position.threats;
+    int our_side = thread.position.side;
+    int opp_side = our_side ^ 1;
+    int result = NO_SCORE;
+
+    thread.move_vector.clear();
+    if (!threats.threats_1[our_side].empty()) {
+        thread.move_vector.push_back(*threats.threats_1[our_side].begin());
+        result = our_side;
+    } else if (!threats.threats_1[opp_side].empty()) {
+        for (Move move : threats.threats_1[opp_side]) thread.move_vector.push_back(move);
+        if (thread.move_vector.size() >= 2) result = opp_side;
+    } else {
+        thread.position.get_moves(thread.move_vector);
+    }
 
-        for (int r = -distance_range; r <= distance_range; r++) {
-            for (int c = -distance_range; c <= distance_range; c++) {
+    int n_moves = thread.move_vector.size();
 
-                int new_row = r + child_node.last_move.row;
-                int new_col = c + child_node.last_move.col;
-                if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) continue;
-                if (new_row == child_node.last_move.row && new_col == child_node.last_move.col) continue;
+    std::array<double, MAX_MOVES> policies{};
+    std::array<uint16_t, MAX_MOVES> order{};
+    std::array<Move, MAX_MOVES> moves{};
 
-                if (!position.is_empty(new_row, new_col)) {
-                    int current_distance = std::max(abs(r), abs(c));
-                    if (current_distance < best_distance) {
-                        best_distance = current_distance;
-                    }
+    // A loaded network gives the priors through its policy head
+    Network<Geometry>& network = NETWORK<Geometry>;
+    alignas(32) std::array<uint8_t, Network<Geometry>::HEAD_INPUTS> activations{};
+    if (network.loaded) network.get_activations(thread.position.accumulator, our_side, activations.data());
 
-                    near_stones++;
-                }
-            }
-        }
+    double max_policy = network.loaded ? -std::numeric_limits<double>::infinity() : 0;
+    for (int i = 0; i < n_moves; i++) {
+        policies[i] = network.loaded ? network.get_policy_logit(activations.data(), thread.move_vector[i]) :
+                      get_policy(thread.position, thread.move_vector[i]);
+        max_policy = std::max(max_policy, policies[i]);
+        moves[i] = thread.move_vector[i];
+        order[i] = i;
+    }
 
-        best_distance = std::max(best_distance, 1.7);
+    // The softmax of the logits, up to its sum since the priors are normalized by the best one anyway
+    if (network.loaded) {
+        for (int i = 0; i < n_moves; i++) policies[i] = std::exp(policies[i] - max_policy);
+        max_policy = 1.0;
+    }
 
+    // Ties go to the move closer to the centre and then keep the board order
+    auto centre_distance = [&moves](uint16_t i) {
+        return std::abs(2 * moves[i].row - (BOARD_HEIGHT - 1)) + std::abs(2 * moves[i].col - (BOARD_WIDTH - 1));
+    };
+
+    std::sort(order.begin(), order.begin() + n_moves, [&](uint16_t a, uint16_t b) {
+        if (policies[a] != policies[b]) return policies[a] > policies[b];
+        if (centre_distance(a) != centre_distance(b)) return centre_distance(a) < centre_distance(b);
+        return a < b;
+    });
+
+    // Priors are normalized to [0.0, 1.0] and quantized into the edges
+    thread.priors.clear();
+    for (int i = 0; i < n_moves; i++) {
+        thread.move_vector[i] = moves[order[i]];
+        thread.priors.push_back(static_cast<uint16_t>(policies[order[i]] / max_policy * MAX_PRIOR + 0.5));
+    }
 
-        policy = near_stones == 0 ? 1.0 :
-                 30 +
-                 near_stones / 4.0 +
-                 (distance_range - best_distance) * 10 +
-                         (current_threats.our_threats_1.find(child_node.last_move) != current_threats.our_threats_1.end() ? 1500 : 0) +
-                         (current_threats.opp_threats_1.find(child_node.last_move) != current_threats.opp_threats_1.end() ? 800 : 0) +
-                         (current_threats.our_threats_2.find(child_node.last_move) != current_threats.our_threats_2.end() ? 150 : 0) +
-                         (current_threats.opp_threats_2.find(child_node.last_move) != current_threats.opp_threats_2.end() ? 80 : 0);
+    return result;
+}
 
-        policies[i] = policy;
-        if (policy > max_policy) {
-            max_policy = policy;
+template <typename Geometry>
+uint32_t MCTS<Geometry>::get_widening_width(int visits) {
+    return static_cast<uint32_t>(std::ceil(WIDENING_CONSTANT * std::sqrt(std::max(visits, 1))));
+}
+
+// The number of the node's edges that selection may choose from
+template <typename Geometry>
+uint32_t MCTS<Geometry>::get_width(uint32_t node_index) {
+    Node& node = tree.graph[node_index];
+
+    if (expansion_mode == FULL_EXPANSION) return node.move_count;
+    return std::min<uint32_t>(node.move_count, get_widening_width(tree.get_visits(node_index)));
+}
+
+/*
+ * Creates the child of the node's next edge and returns its index, or ARENA_FULL if the memory budget is used up.
+ * A full children block is copied to one twice its size at the end of the arena and the grandchildren are pointed
+ * at the copies, the old block is dropped by the next flatten_tree. This keeps the copies and the abandoned blocks
+ * linear in the number of children.
+ *
+ * Other threads could be inside the old block, so tree parallel searches create every child at expansion instead.
+ */
+template <typename Geometry>
+uint32_t MCTS<Geometry>::add_child(uint32_t node_index) {
+    Node& node = tree.graph[node_index];
+    uint32_t n_children = node.children_end - node.children_start;
+
+    if (n_children == node.children_capacity) {
+        uint32_t capacity = std::min<uint32_t>(std::max<uint32_t>(2 * n_children, 1), node.move_count);
+
+        uint32_t children_start = tree.graph.claim(capacity);
+        if (children_start == ARENA_FULL) return ARENA_FULL;
+
+        for (uint32_t i = 0; i < n_children; i++) {
+            tree.copy_node(children_start + i, node.children_start + i);
+            Node& child_node = tree.graph[children_start + i];
+
+            if (child_node.children_end > child_node.children_start && !child_node.is_transposition()) {
+                tree.move_transposition(node.children_start + i, children_start + i);
+            }
+
+            for (uint32_t grandchild_index = child_node.children_start;
+                 grandchild_index < child_node.children_end; grandchild_index++) {
+                tree.graph[grandchild_index].parent = children_start + i;
+            }
         }
-    }
 
-    // Normalize policies to [0.0, 1.0]
-    for (double& policy : policies) {
-        policy /= max_policy;
+        node.children_start = children_start;
+        node.children_end = children_start + n_children;
+        node.children_capacity = capacity;
     }
 
-    uint32_t best_node_index = 0;
-    double best_puct = -1000000;
+    uint32_t child_node_index = node.children_end;
+    tree.create_node(child_node_index, node_index, tree.edges[node.edges_start + n_children].get_move());
+    node.children_end++;
+
+    return child_node_index;
+}
+
+template <typename Geometry>
+uint32_t MCTS<Geometry>::select_best_child(uint32_t node_index) {
+
+    Node& node = tree.graph[node_index];
+
+    uint32_t children_end = node.get_children_end();
+    uint32_t children_start = node.get_children_start();
+    uint16_t* priors = &tree.priors[node.edges_start];
 
-    for (int i = 0; i < n_children; i++) {
-        uint32_t child_node_index = tree.graph[node_index].children_start + i;
-        Node child_node = tree.graph[child_node_index];
+    uint32_t width = get_width(node_index);
+    uint32_t n_created = children_end - children_start;
+    uint32_t n_children = std::min(n_created, width);
 
-        double exploitation_value = static_cast<double>(child_node.win_count) / static_cast<double>(child_node.visits);
-        double exploration_value = EXPLORATION_CONSTANT * std::sqrt(node.visits) / (1 + child_node.visits);
+    // Win counts are in RESULT_UNITS, the exploration term is scaled to match
+    auto exploration = static_cast<float>(EXPLORATION_CONSTANT * RESULT_UNITS * std::sqrt(tree.get_visits(node_index))
+                                          / MAX_PRIOR);
 
-        double puct = exploitation_value + exploration_value * policies[i];
+    float best_puct;
+    uint32_t best_offset = select_puct(&tree.visits[children_start], &tree.win_counts[children_start], priors,
+                                       &tree.proofs[children_start], n_children, exploration, best_puct);
+
+    // Once every child in the width is proven, the node can only be proven through the children beyond it
+    bool all_proven = best_puct == -std::numeric_limits<float>::infinity();
+    if (all_proven && n_children < n_created) {
+        n_children = n_created;
+        best_offset = select_puct(&tree.visits[children_start], &tree.win_counts[children_start], priors,
+                                  &tree.proofs[children_start], n_children, exploration, best_puct);
+        all_proven = best_puct == -std::numeric_limits<float>::infinity();
+    }
+
+    /*
+     * Edges without a child are scored like a new child, one visit and no wins, so only their prior counts.
+     * They are sorted by prior, so only the next one can beat the children, and its child is created once it does.
+     */
+    if (search_mode != TREE_PARALLEL && n_children < node.move_count && (n_children < width || all_proven)) {
+        float puct = exploration * static_cast<float>(priors[n_children]) / 2.0f;
 
         if (puct > best_puct) {
-            best_puct = puct;
-            best_node_index = child_node_index;
+            uint32_t child_node_index = add_child(node_index);
+            if (child_node_index != ARENA_FULL) return child_node_index;
         }
     }
 
-    return best_node_index;
+    // When every child is proven and no more fit, a proven child is returned and selection stops at it
+    return children_start + best_offset;
 }
 
-uint32_t MCTS::selection() {
+template <typename Geometry>
+uint32_t MCTS<Geometry>::selection(SearchThread<Geometry>& thread, int& leaf_result) {
     uint32_t leaf_node_index = root_node_index;
+    leaf_result = NO_SCORE;
+    thread.orientation = IDENTITY;
 
     int depth = 0;
     while (true) {
 
-        if (tree.graph[leaf_node_index].children_end <= tree.graph[leaf_node_index].children_start) break;
+        uint32_t children_node_index = resolve_transposition(thread, leaf_node_index);
 
-        leaf_node_index = select_best_child(leaf_node_index);
+        // A proven node is searched no further, its result is back propagated like a terminal one
+        int proven_result = tree.get_proven_result(children_node_index);
+        if (proven_result != NO_SCORE) {
+            leaf_result = proven_result;
+            break;
+        }
 
-        position.make_move<MOVE_ADJACENCY>(tree.graph[leaf_node_index].last_move);
-        ply++;
+        uint32_t children_end = tree.graph[children_node_index].get_children_end();
+        if (children_end <= tree.graph[children_node_index].get_children_start()) break;
+
+        leaf_node_index = select_best_child(children_node_index);
+
+        leaf_result = make_tree_move(thread, leaf_node_index);
         depth++;
 
     }
 
-    seldepth = std::max<PLY_TYPE>(seldepth, depth);
+    thread.seldepth = std::max<PLY_TYPE>(thread.seldepth, depth);
     return leaf_node_index;
 }
 
-void MCTS::expansion(uint32_t node_index) {
-    position.get_moves(move_vectors[0]);
-    tree.graph[node_index].children_start = tree.graph.size();
-    for (Move move : move_vectors[0]) {
-        tree.graph.emplace_back(node_index, move);
+template <typename Geometry>
+bool MCTS<Geometry>::expansion(SearchThread<Geometry>& thread, uint32_t node_index) {
+    Node& node = tree.graph[node_index];
+
+    /*
+     * In tree parallel searches the first thread to swap children_start from 0 to EXPANDING
+     * expands the node, any other thread reaching it in the meantime just simulates from it.
+     */
+    if (search_mode == TREE_PARALLEL) {
+        uint32_t expected = 0;
+        if (!std::atomic_ref<uint32_t>(node.children_start).compare_exchange_strong(expected, EXPANDING)) {
+            return false;
+        }
     }
-    tree.graph[node_index].children_end = tree.graph.size();
-}
 
-void MCTS::simulation(uint32_t node_index, int thread_id) {
-    Position* current_position;
-    PLY_TYPE start_ply = ply;
+    int canonical_symmetry = thread.position.get_canonical_symmetry();
+    uint64_t hash_key = thread.position.symmetric_keys[canonical_symmetry];
+
+    // The node's orientation to the canonical one, through the position's
+    int symmetry = combine_symmetries(canonical_symmetry, thread.orientation);
+
+    // The position was expanded through another move order or orientation, the node shares its children instead
+    uint32_t transposition_index = transpositions ? tree.find_transposition(hash_key) : NO_NODE;
+    if (transposition_index != NO_NODE) {
+        tree.hash_keys[node_index] = hash_key;
+        tree.symmetries[node_index] = combine_symmetries(INVERSE_SYMMETRIES[symmetry],
+                                                         tree.symmetries[transposition_index]);
+        std::atomic_ref<uint32_t>(node.children_start).store(TRANSPOSITION, std::memory_order_relaxed);
+        std::atomic_ref<uint32_t>(node.children_end).store(TRANSPOSITION, std::memory_order_release);
+        return true;
+    }
 
-    if (thread_id != 0) {
-        test_positions[thread_id] = position;
-        current_position = &test_positions[thread_id];
-    } else {
-        current_position = &position;
+    int forced_result = generate_children(thread);
+    uint32_t n_moves = thread.move_vector.size();
+
+    // Only the best move gets a child for now, except in tree parallel searches where children blocks can't move
+    uint32_t n_children = search_mode == TREE_PARALLEL ? n_moves : std::min<uint32_t>(n_moves, 1);
+
+    uint32_t edges_start = n_moves == 0 ? ARENA_FULL : tree.edges.claim(n_moves);
+    uint32_t children_start = edges_start == ARENA_FULL ? ARENA_FULL : tree.graph.claim(n_children);
+
+    // The memory budget is used up or there are no moves, the node stays a leaf and the edges are given back
+    if (children_start == ARENA_FULL) {
+        if (edges_start != ARENA_FULL) tree.edges.unclaim(edges_start, n_moves);
+        std::atomic_ref<uint32_t>(node.children_start).store(0, std::memory_order_relaxed);
+        return false;
     }
 
-    Move last_move = tree.graph[node_index].last_move;
+    // Moves are generated for the position, the node's edges and children are in its orientation
+    int inverse_orientation = INVERSE_SYMMETRIES[thread.orientation];
+    for (uint32_t i = 0; i < n_moves; i++) {
+        Move move = transform_move<Geometry>(thread.move_vector[i], inverse_orientation);
+        tree.edges[edges_start + i] = Edge{static_cast<uint8_t>(move.row), static_cast<uint8_t>(move.col)};
+        tree.priors[edges_start + i] = thread.priors[i];
+    }
 
-    int current_result = NO_SCORE;
-    for (int depth = 0; depth < MAX_SIMULATION_DEPTH; depth++) {
+    for (uint32_t i = 0; i < n_children; i++) {
+        tree.create_node(children_start + i, node_index, tree.edges[edges_start + i].get_move());
+    }
+    uint32_t children_end = children_start + n_children;
 
-        current_result = current_position->get_result(last_move);
-        if (current_result != NO_SCORE) break;
+    node.edges_start = edges_start;
+    node.move_count = n_moves;
+    node.children_capacity = n_children;
+    tree.hash_keys[node_index] = hash_key;
+    tree.symmetries[node_index] = symmetry;
+
+    // The iteration that expanded the node proves it along its path
+    if (forced_result != NO_SCORE) tree.set_proven_result(node_index, forced_result);
+
+    std::atomic_ref<uint32_t>(node.children_start).store(children_start, std::memory_order_relaxed);
+    std::atomic_ref<uint32_t>(node.children_end).store(children_end, std::memory_order_release);
+
+    if (transpositions) tree.store_transposition(hash_key, node_index);
+
+    return true;
+}
+
+template <typename Geometry>
+void MCTS<Geometry>::simulation(SearchThread<Geometry>& thread) {
+    Position<Geometry>& current_position = thread.position;
+    PLY_TYPE start_ply = thread.ply;
+
+    // A truncated rollout stops early and is scored by the evaluator, a loaded network scores the leaf itself
+    bool evaluated = rollout_depth != FULL_ROLLOUTS || NETWORK<Geometry>.loaded;
+    int max_depth = rollout_depth != FULL_ROLLOUTS ? std::min<int>(rollout_depth, MAX_SIMULATION_DEPTH) :
+                    evaluated ? 0 : MAX_SIMULATION_DEPTH;
+
+    // The position the simulation starts from is never terminal, search back propagates those directly
+    int current_result = NO_SCORE;
+    for (int depth = 0; depth < max_depth; depth++) {
 
         // int adjacency_range = 1;
 
-        Threats threats{};
-        current_position->get_threats(threats);
-        last_move = !threats.our_threats_1.empty() ? *threats.our_threats_1.begin() :
-                    !threats.opp_threats_1.empty() ? *threats.opp_threats_1.begin() :
-                    !threats.our_threats_2.empty() ? *threats.our_threats_2.begin() :
-                    !threats.opp_threats_2.empty() ? *threats.opp_threats_2.begin() :
-                    NO_MOVE;
+        Threats<Geometry>& threats = current_position.threats;
+        int our_side = current_position.side;
+        int opp_side = current_position.side ^ 1;
+
+        Move last_move = !threats.threats_1[our_side].empty() ? *threats.threats_1[our_side].begin() :
+                         !threats.threats_1[opp_side].empty() ? *threats.threats_1[opp_side].begin() :
+                         !threats.threats_2[our_side].empty() ? *threats.threats_2[our_side].begin() :
+                         !threats.threats_2[opp_side].empty() ? *threats.threats_2[opp_side].begin() :
+                         NO_MOVE;
 
         if (last_move.row == BOARD_HEIGHT && last_move.col == BOARD_WIDTH) {
-            current_position->get_direct_adjacent_moves(move_vectors[thread_id]);
-            if (move_vectors[thread_id].empty()) {
+            MoveSet<Geometry>& frontier = current_position.get_frontier();
+            if (frontier.empty()) {
                 current_result = DRAW_SCORE;
                 break;
             }
-            last_move = move_vectors[thread_id][rand() % move_vectors[thread_id].size()];
+            last_move = frontier[thread.random.bounded(frontier.size())];
         }
 
-        current_position->make_move<MOVE_ADJACENCY>(last_move);
-        if (thread_id == 0) {
-            state_stack[ply].move = last_move;
-            ply++;
-        }
-    }
+        current_result = current_position.template make_move_get_result<MOVE_ADJACENCY>(last_move);
+        thread.state_stack[thread.ply].move = last_move;
+        thread.ply++;
 
-    if (thread_id == 0) {
-        while (ply > start_ply) {
-            ply--;
-            current_position->undo_move<MOVE_ADJACENCY>(state_stack[ply].move);
-        }
+        if (current_result != NO_SCORE) break;
     }
 
-    if (current_result == NO_SCORE) current_result = DRAW_SCORE;
+    if (current_result == NO_SCORE && evaluated) {
+        int value = evaluate(current_position);
+        thread.simulation_value = current_position.side == WHITE ? value : -value;
+    } else {
+        thread.simulation_value = get_result_value(current_result == NO_SCORE ? DRAW_SCORE : current_result);
+    }
 
-    simulation_results[thread_id] = current_result;
+    while (thread.ply > start_ply) {
+        thread.ply--;
+        current_position.template undo_move<MOVE_ADJACENCY>(thread.state_stack[thread.ply].move);
+    }
 }
 
-void MCTS::back_propagation(uint32_t node_index, int result) {
-
-    uint32_t current_node_index = node_index;
-    int current_side = position.side ^ 1;
-    while (true) {
-        Node& current_node = tree.graph[current_node_index];
-
-        current_node.visits++;
-        if (current_side == result) current_node.win_count++;
-        else if ((current_side ^ 1) == result) current_node.win_count--;
-
-        if (current_node.parent == current_node_index) break;  // Hit root
+/*
+ * Follows the thread's path back to the root with the iteration's value for white in RESULT_UNITS, a node reached
+ * through several move orders only credits the parent the thread came from. A transposition keeps the statistics of
+ * its own edge, the node it shares its children with counts the visits of every path, so its children are explored
+ * like the children of the transposition.
+ */
+template <typename Geometry>
+void MCTS<Geometry>::back_propagation(SearchThread<Geometry>& thread, int value) {
+
+    int current_side = thread.position.side ^ 1;
+    for (int ply = thread.ply; ply >= 0; ply--) {
+        PathNode path_node = thread.path[ply];
+
+        int win_count_delta = current_side == WHITE ? value : -value;
+
+        // Every node below the root had a virtual loss added when it was selected
+        if (ply == 0) tree.add_statistics(path_node.node_index, 1, win_count_delta);
+        else tree.add_statistics(path_node.node_index, 1 - virtual_loss,
+                                 win_count_delta + virtual_loss * RESULT_UNITS);
+
+        if (path_node.children_node_index != path_node.node_index) {
+            tree.add_statistics(path_node.children_node_index, 1, win_count_delta);
+        }
 
-        current_node_index = current_node.parent;
         current_side ^= 1;
     }
 
@@ -231,139 +622,644 @@ void MCTS::back_propagation(uint32_t node_index, int result) {
     // }
 }
 
-uint32_t MCTS::get_best_node() {
+// The result of a node decided by its children for the side to move, or NO_SCORE while it isn't decided
+template <typename Geometry>
+int MCTS<Geometry>::get_children_result(uint32_t node_index, int side) {
+    Node& node = tree.graph[node_index];
+    uint32_t children_end = node.get_children_end();
+    uint32_t children_start = node.get_children_start();
+
+    // Moves without a child aren't proven yet
+    if (children_end <= children_start || children_end - children_start < node.move_count) return NO_SCORE;
+
+    bool draw = false;
+    for (uint32_t child_node_index = children_start; child_node_index < children_end; child_node_index++) {
+        int result = tree.get_proven_result(child_node_index);
+        if (result == side || result == NO_SCORE) return result;
+        if (result == DRAW_SCORE) draw = true;
+    }
+
+    return draw ? DRAW_SCORE : side ^ 1;
+}
+
+/*
+ * MCTS-Solver: the position of the thread's leaf has a proven result, which is passed up the path for as long as it
+ * decides the parent too. The side to move wins a node as soon as one child is a win for it, and otherwise the node
+ * is only decided once every move has a proven child: a draw if one of them is drawn and a loss if none is.
+ * Proven children are skipped by selection and the search stops once the root is proven.
+ */
+template <typename Geometry>
+void MCTS<Geometry>::prove(SearchThread<Geometry>& thread, int result) {
+    int side = thread.position.side;
+
+    for (int ply = thread.ply; ply >= 0; ply--) {
+        PathNode path_node = thread.path[ply];
+        tree.set_proven_result(path_node.node_index, result);
+        tree.set_proven_result(path_node.children_node_index, result);
+
+        if (ply == 0) {
+            stopped = true;
+            break;
+        }
+
+        // The side to move at the parent
+        side ^= 1;
+        if (result != side) {
+            result = get_children_result(thread.path[ply - 1].children_node_index, side);
+            if (result == NO_SCORE) break;
+        }
+    }
+}
+
+template <typename Geometry>
+bool MCTS<Geometry>::is_solved() {
+    return tree.get_proven_result(root_node_index) != NO_SCORE;
+}
+
+/*
+ * A root parallel helper that solved its root settles the search, once the root here has the edges that
+ * merge_root_statistics creates the children of the helper's proven moves from.
+ */
+template <typename Geometry>
+bool MCTS<Geometry>::is_solved_by_helper() {
+    if (search_mode != ROOT_PARALLEL) return false;
+
+    Node& root = tree.graph[root_node_index];
+    if (root.children_end == 0) return false;
+
+    for (auto& searcher : root_searchers) {
+        if (searcher->is_solved()) return true;
+    }
+
+    return false;
+}
+
+template <typename Geometry>
+uint32_t MCTS<Geometry>::get_best_node() {
+    Node& root = tree.graph[root_node_index];
+    RootStatistics<Geometry> helper_statistics = get_helper_statistics();
+
+    // Tree parallel workers are still adding children and statistics, so they are read like selection reads them.
+    // An end of 0 means the root's children aren't published yet.
+    uint32_t children_end = root.get_children_end();
+    uint32_t children_start = root.get_children_start();
+    uint32_t n_children = children_end > children_start ? children_end - children_start : 0;
+
+    // A proven win is played straight away and a proven loss only when nothing else is left
+    int best_rank = -1;
     int best = -1;
     uint32_t best_index = 0;
-    for (int i = 0; i < tree.graph[root_node_index].children_end - tree.graph[root_node_index].children_start; i++) {
-        Node& node = tree.graph[tree.graph[root_node_index].children_start + i];
-        if (node.visits >= best) {
-            best = node.visits;
-            best_index = tree.graph[root_node_index].children_start + i;
+    for (uint32_t i = 0; i < n_children; i++) {
+        MoveStatistics statistics = get_move_statistics(children_start + i, helper_statistics);
+
+        int result = statistics.proven_result;
+        int rank = result == position.side ? 2 : result == (position.side ^ 1) ? 0 : 1;
+        if (rank > best_rank || (rank == best_rank && statistics.visits >= best)) {
+            best_rank = rank;
+            best = statistics.visits;
+            best_index = children_start + i;
         }
     }
 
     return best_index;
 }
 
-uint32_t MCTS::search() {
-    seldepth = 0;
-    iterations = 0;
-    uint32_t selected_node_index = root_node_index;
+// In root parallel searches the helpers' trees vote too, through the statistics they published last
+template <typename Geometry>
+RootStatistics<Geometry> MCTS<Geometry>::get_helper_statistics() {
+    RootStatistics<Geometry> helper_statistics{};
+    if (search_mode != ROOT_PARALLEL) return helper_statistics;
 
-    for (int iteration = 0; iteration < MAX_ITERATIONS; iteration++) {
-        iterations = iteration;
+    for (auto& searcher : root_searchers) {
+        searcher->add_root_statistics(helper_statistics);
+    }
 
-        descend_to_root(selected_node_index);
-        selected_node_index = selection();
+    return helper_statistics;
+}
 
-        // tree.graph[selected_node_index].visits++;
+// The statistics of a root child together with the helpers' votes for its move
+template <typename Geometry>
+MoveStatistics MCTS<Geometry>::get_move_statistics(uint32_t node_index,
+                                                   RootStatistics<Geometry>& helper_statistics) {
+    Move move = tree.graph[node_index].last_move;
 
-        int node_result = position.get_result(tree.graph[selected_node_index].last_move);
-        if (node_result == NO_SCORE && tree.graph[selected_node_index].visits >= 2) {
+    MoveStatistics statistics{};
+    statistics.visits = tree.get_visits(node_index) + helper_statistics.visits[move.row][move.col];
+    statistics.win_count = tree.get_win_count(node_index) + helper_statistics.win_counts[move.row][move.col];
+    statistics.proven_result = tree.get_proven_result(node_index);
 
-            expansion(selected_node_index);
+    uint8_t helper_proof = helper_statistics.proofs[move.row][move.col];
+    if (statistics.proven_result == NO_SCORE && helper_proof != UNPROVEN) statistics.proven_result = helper_proof - 1;
 
-            if (tree.graph[selected_node_index].children_end > tree.graph[selected_node_index].children_start) {
-                int random_index = rand() % (tree.graph[selected_node_index].children_end - tree.graph[selected_node_index].children_start);
-                selected_node_index = tree.graph[selected_node_index].children_start + random_index;
-                position.make_move<MOVE_ADJACENCY>(tree.graph[selected_node_index].last_move);
-                ply++;
-            }
+    return statistics;
+}
+
+template <typename Geometry>
+MoveStatistics MCTS<Geometry>::get_move_statistics(uint32_t node_index) {
+    RootStatistics<Geometry> helper_statistics = get_helper_statistics();
+    return get_move_statistics(node_index, helper_statistics);
+}
+
+template <typename Geometry>
+void MCTS<Geometry>::publish_root_statistics() {
+    Node& root = tree.graph[root_node_index];
+
+    for (uint32_t child_node_index = root.children_start; child_node_index < root.children_end; child_node_index++) {
+        Node& node = tree.graph[child_node_index];
+        Move move = node.last_move;
+
+        std::atomic_ref<int>(published_root_statistics.visits[move.row][move.col])
+                .store(tree.visits[child_node_index], std::memory_order_relaxed);
+        std::atomic_ref<int>(published_root_statistics.win_counts[move.row][move.col])
+                .store(tree.win_counts[child_node_index], std::memory_order_relaxed);
+        std::atomic_ref<uint8_t>(published_root_statistics.proofs[move.row][move.col])
+                .store(tree.proofs[child_node_index], std::memory_order_relaxed);
+    }
+}
+
+template <typename Geometry>
+void MCTS<Geometry>::add_root_statistics(RootStatistics<Geometry>& statistics) {
+    for (int row = 0; row < BOARD_HEIGHT; row++) {
+        for (int col = 0; col < BOARD_WIDTH; col++) {
+            statistics.visits[row][col] += std::atomic_ref<int>(published_root_statistics.visits[row][col])
+                    .load(std::memory_order_relaxed);
+            statistics.win_counts[row][col] += std::atomic_ref<int>(published_root_statistics.win_counts[row][col])
+                    .load(std::memory_order_relaxed);
+
+            uint8_t proof = std::atomic_ref<uint8_t>(published_root_statistics.proofs[row][col])
+                    .load(std::memory_order_relaxed);
+            if (proof != UNPROVEN) statistics.proofs[row][col] = proof;
         }
+    }
+}
 
-        if (node_result == NO_SCORE) {
+template <typename Geometry>
+void MCTS<Geometry>::prepare_root_searchers() {
+    int helpers = thread_pool.size() - 1;
 
-            for (int thread_id = 1; thread_id < THREADS; thread_id++) {
-                simulation_results[thread_id] = NO_SCORE;
-                simulation_threads[thread_id] = std::thread([this, selected_node_index, thread_id](){
-                    this->simulation(selected_node_index, thread_id);
-                });
-            }
+    root_searchers.resize(helpers);
+    for (int helper = 0; helper < helpers; helper++) {
+        auto& searcher = root_searchers[helper];
+        if (!searcher) {
+            searcher = std::make_unique<MCTS>(get_tree_bytes(), huge_pages);
+            searcher->set_seed(get_stream_seed(~seed, helper + 1));
+        }
+
+        searcher->position = position;
+        searcher->search_mode = LEAF_PARALLEL;
+        searcher->expansion_mode = expansion_mode;
+        searcher->transpositions = transpositions;
+        searcher->solver_mode = solver_mode;
+        searcher->rollout_depth = rollout_depth;
+        searcher->virtual_loss = 0;
+        searcher->published_root_statistics = RootStatistics<Geometry>{};
+
+        searcher->tree.clear();
+        searcher->tree.emplace_back(0, NO_MOVE);
+        searcher->root_node_index = 0;
+
+        SearchThread<Geometry>& thread = searcher->search_threads[0];
+        thread.position = position;
+        thread.ply = 0;
+        thread.seldepth = 0;
+    }
+}
+
+/*
+ * Gives every root move that a helper searched or proved a child here, since children are created lazily and
+ * get_best_node only chooses between children. The helpers' visits and wins stay out of the tree, whose nodes have
+ * to agree with their subtrees when it is reused for the next move, get_move_statistics adds them for reporting.
+ * Proofs hold in every tree and are copied.
+ */
+template <typename Geometry>
+void MCTS<Geometry>::merge_root_statistics() {
+    RootStatistics<Geometry> helper_statistics = get_helper_statistics();
+    for (auto& searcher : root_searchers) {
+        seldepth = std::max(seldepth, searcher->search_threads[0].seldepth);
+    }
+
+    Node& root = tree.graph[root_node_index];
+    if (root.children_end == 0) return;
+
+    uint32_t voted_edges = 0;
+    for (uint32_t i = 0; i < root.move_count; i++) {
+        Move move = tree.edges[root.edges_start + i].get_move();
+        if (helper_statistics.visits[move.row][move.col] != 0 || helper_statistics.proofs[move.row][move.col]) {
+            voted_edges = i + 1;
+        }
+    }
+
+    while (root.children_end - root.children_start < voted_edges) {
+        if (add_child(root_node_index) == ARENA_FULL) break;
+    }
+
+    for (uint32_t child_node_index = root.children_start; child_node_index < root.children_end; child_node_index++) {
+        Move move = tree.graph[child_node_index].last_move;
+
+        if (helper_statistics.proofs[move.row][move.col] != UNPROVEN) {
+            tree.proofs[child_node_index] = helper_statistics.proofs[move.row][move.col];
+        }
+    }
+}
+
+template <typename Geometry>
+void MCTS<Geometry>::leaf_parallel_iteration(SearchThread<Geometry>& thread) {
+    descend_to_root(thread);
+
+    int node_result;
+    uint32_t selected_node_index = selection(thread, node_result);
+
+    // tree.graph[selected_node_index].visits++;
+
+    if (node_result == NO_SCORE && thread.position.is_full()) node_result = DRAW_SCORE;
 
-            simulation(selected_node_index, 0);
-            back_propagation(selected_node_index, simulation_results[0]);
+    if (node_result == NO_SCORE && tree.get_visits(selected_node_index) >= 2) {
 
-            for (int thread_id = 1; thread_id < THREADS; thread_id++) {
-                simulation_threads[thread_id].join();
-                back_propagation(selected_node_index, simulation_results[thread_id]);
+        if (expansion(thread, selected_node_index)) {
+            uint32_t children_node_index = resolve_transposition(thread, selected_node_index);
+            node_result = tree.get_proven_result(children_node_index);
+
+            if (node_result == NO_SCORE) {
+                selected_node_index = select_best_child(children_node_index);
+                node_result = make_tree_move(thread, selected_node_index);
+                if (node_result == NO_SCORE) node_result = tree.get_proven_result(selected_node_index);
             }
+        }
+    }
+
+    // A new leaf is searched for a forced win before its rollout, the root is left to the tree
+    if (node_result == NO_SCORE && solver_mode != SOLVER_OFF && thread.ply != 0) {
+        thread.engine.mode = solver_mode;
+        node_result = thread.engine.solve(thread.position, LEAF_SOLVER_DEPTH, LEAF_SOLVER_NODES);
+    }
+
+    // Root parallel searches use the pool for their own trees, so they only roll out once
+    int threads = search_mode == LEAF_PARALLEL ? thread_pool.size() : 1;
+
+    if (node_result == NO_SCORE && threads == 1) {
+        simulation(thread);
+        back_propagation(thread, thread.simulation_value);
+
+    } else if (node_result == NO_SCORE) {
+
+        // Helpers play their rollouts from a copy of the leaf
+        for (int thread_id = 1; thread_id < threads; thread_id++) {
+            search_threads[thread_id].position = thread.position;
+        }
+
+        thread_pool.start([this](int thread_id){
+            this->simulation(search_threads[thread_id]);
+        });
+
+        simulation(thread);
+        thread_pool.wait();
 
-        } else {
-            for (int t_simulation = 0; t_simulation < THREADS; t_simulation++) {
-                back_propagation(selected_node_index, node_result);
+        for (int thread_id = 0; thread_id < threads; thread_id++) {
+            back_propagation(thread, search_threads[thread_id].simulation_value);
+        }
+
+    } else {
+        prove(thread, node_result);
+
+        for (int t_simulation = 0; t_simulation < threads; t_simulation++) {
+            back_propagation(thread, get_result_value(node_result));
+        }
+    }
+}
+
+template <typename Geometry>
+void MCTS<Geometry>::tree_parallel_iteration(SearchThread<Geometry>& thread) {
+    descend_to_root(thread);
+
+    int node_result;
+    uint32_t selected_node_index = selection(thread, node_result);
+
+    // Our own virtual loss is already on the leaf's visits
+    int leaf_visits = tree.get_visits(selected_node_index);
+    if (selected_node_index != root_node_index) leaf_visits -= virtual_loss;
+
+    if (node_result == NO_SCORE && thread.position.is_full()) node_result = DRAW_SCORE;
+
+    if (node_result == NO_SCORE && leaf_visits >= 2) {
+
+        if (expansion(thread, selected_node_index)) {
+            uint32_t children_node_index = resolve_transposition(thread, selected_node_index);
+            node_result = tree.get_proven_result(children_node_index);
+
+            if (node_result == NO_SCORE) {
+                selected_node_index = select_best_child(children_node_index);
+                node_result = make_tree_move(thread, selected_node_index);
+                if (node_result == NO_SCORE) node_result = tree.get_proven_result(selected_node_index);
             }
         }
+    }
 
-        if ((iteration & 1023) == 0) {
-            auto time = std::chrono::high_resolution_clock::now();
-            uint64_t current_time = std::chrono::duration_cast<std::chrono::milliseconds>
-                    (std::chrono::time_point_cast<std::chrono::milliseconds>(time).time_since_epoch()).count();
+    // A new leaf is searched for a forced win before its rollout, the root is left to the tree
+    if (node_result == NO_SCORE && solver_mode != SOLVER_OFF && thread.ply != 0) {
+        thread.engine.mode = solver_mode;
+        node_result = thread.engine.solve(thread.position, LEAF_SOLVER_DEPTH, LEAF_SOLVER_NODES);
+    }
 
-            if (current_time - start_time >= MAX_TIME) {
-                break;
+    int value;
+    if (node_result == NO_SCORE) {
+        simulation(thread);
+        value = thread.simulation_value;
+    } else {
+        prove(thread, node_result);
+        value = get_result_value(node_result);
+    }
+
+    back_propagation(thread, value);
+}
+
+template <typename Geometry>
+void MCTS<Geometry>::parallel_iteration(int thread_id, int iteration) {
+    if (search_mode == TREE_PARALLEL) {
+        tree_parallel_iteration(search_threads[thread_id]);
+    } else if (thread_id == 0) {
+        leaf_parallel_iteration(search_threads[0]);
+    } else {
+        MCTS& searcher = *root_searchers[thread_id - 1];
+        searcher.leaf_parallel_iteration(searcher.search_threads[0]);
+        if ((iteration & 1023) == 0) searcher.publish_root_statistics();
+    }
+}
+
+template <typename Geometry>
+bool MCTS<Geometry>::check_time(int iteration) {
+    if ((iteration & 1023) != 0) return false;
+
+    auto time = std::chrono::high_resolution_clock::now();
+    uint64_t current_time = std::chrono::duration_cast<std::chrono::milliseconds>
+            (std::chrono::time_point_cast<std::chrono::milliseconds>(time).time_since_epoch()).count();
+
+    return current_time - start_time >= MAX_TIME;
+}
+
+template <typename Geometry>
+void MCTS<Geometry>::print_progress(int iteration) {
+    if ((iteration % 1000) != 0 || iteration == 0) return;
+
+    uint64_t best_node_index = get_best_node();
+    MoveStatistics statistics = get_move_statistics(best_node_index);
+
+    double win_probability = get_win_probability(statistics.win_count, statistics.visits);
+    std::string win_probability_color = win_probability >  30 ? GREEN :
+                                        win_probability < -30 ? RED   :
+                                        YELLOW;
+    std::cout << "\riteration [" << CYAN << iterations << RESET << "]"
+              << " depth ["      << CYAN << search_threads[0].seldepth << RESET << "]"
+              << " pv ["         << CYAN
+              << tree.graph[best_node_index].last_move.row << ", "
+              << tree.graph[best_node_index].last_move.col
+              << RESET << "]"
+              << " confidence [" << win_probability_color << win_probability << "%" << RESET << "]"
+              << std::flush;
+}
+
+template <typename Geometry>
+uint32_t MCTS<Geometry>::search() {
+    seldepth = 0;
+    iterations = 0;
+
+    // A root proof that its own children don't carry, from a root parallel helper or the leaf solver, is searched
+    // again for the move
+    if (get_children_result(root_node_index, position.side) == NO_SCORE) tree.proofs[root_node_index] = UNPROVEN;
+    stopped = is_solved();
+    virtual_loss = search_mode == TREE_PARALLEL ? VIRTUAL_LOSS : 0;
+
+    for (SearchThread<Geometry>& thread : search_threads) {
+        thread.position = position;
+        thread.ply = 0;
+        thread.seldepth = 0;
+    }
+
+    if (search_mode != LEAF_PARALLEL) {
+        if (search_mode == ROOT_PARALLEL) prepare_root_searchers();
+
+        // Thread 0 also keeps time and prints progress, the helpers run until it stops the search
+        auto search_loop = [this](int thread_id) {
+            for (int iteration = 0; !stopped.load(std::memory_order_relaxed); iteration++) {
+                parallel_iteration(thread_id, iteration);
+
+                if (static_cast<uint64_t>(iterations.fetch_add(1, std::memory_order_relaxed)) + 1 >= MAX_ITERATIONS) {
+                    stopped = true;
+                }
+
+                if (thread_id == 0) {
+                    if (check_time(iteration) || is_solved_by_helper()) stopped = true;
+                    print_progress(iteration);
+                }
+            }
+        };
+
+        thread_pool.start(search_loop);
+        search_loop(0);
+        thread_pool.wait();
+
+        if (search_mode == ROOT_PARALLEL) {
+            for (auto& searcher : root_searchers) {
+                searcher->publish_root_statistics();
             }
+
+            merge_root_statistics();
         }
 
-        if ((iteration % 1000) == 0 && iteration != 0) {
-            uint64_t best_node_index = get_best_node();
-            double win_probability = get_win_probability(best_node_index);
-            std::string win_probability_color = win_probability >  30 ? GREEN :
-                                                win_probability < -30 ? RED   :
-                                                YELLOW;
-            std::cout << "\riteration [" << CYAN << iteration << RESET << "]"
-                      << " depth ["      << CYAN << seldepth  << RESET << "]"
-                      << " pv ["         << CYAN
-                      << tree.graph[best_node_index].last_move.row << ", "
-                      << tree.graph[best_node_index].last_move.col
-                      << RESET << "]"
-                      << " confidence [" << win_probability_color << win_probability << "%" << RESET << "]"
-                      << std::flush;
+    } else {
+        for (int iteration = 0; static_cast<uint64_t>(iteration) < MAX_ITERATIONS && !stopped; iteration++) {
+            iterations = iteration;
+
+            leaf_parallel_iteration(search_threads[0]);
+
+            if (check_time(iteration)) break;
+            print_progress(iteration);
         }
     }
 
-    descend_to_root(selected_node_index);
+    for (SearchThread<Geometry>& thread : search_threads) {
+        seldepth = std::max(seldepth, thread.seldepth);
+    }
+
     uint64_t best_node_index = get_best_node();
     std::cout << std::endl;
 
     return best_node_index;
 }
 
-void MCTS::flatten_tree() {
-    std::vector copy_graph = tree.graph;
+/*
+ * Fills the transposition table again from the expanded nodes after it was reallocated. Transpositions whose
+ * position lost its slot to another one go back to being leaves.
+ */
+template <typename Geometry>
+void MCTS<Geometry>::rebuild_transpositions() {
+    tree.clear_transpositions();
+
+    for (uint32_t node_index = 0; node_index < tree.graph.size(); node_index++) {
+        Node& node = tree.graph[node_index];
+        if (transpositions && node.children_end > node.children_start && !node.is_transposition()) {
+            tree.store_transposition(tree.hash_keys[node_index], node_index);
+        }
+    }
+
+    for (uint32_t node_index = 0; node_index < tree.graph.size(); node_index++) {
+        Node& node = tree.graph[node_index];
+        if (node.is_transposition() && tree.find_transposition(tree.hash_keys[node_index]) == NO_NODE) {
+            node.children_start = 0;
+            node.children_end = 0;
+        }
+    }
+}
+
+// Turns every move of the tree by the symmetry, the symmetries of the nodes follow so that the tree stays the same
+template <typename Geometry>
+void MCTS<Geometry>::reorient_tree(int symmetry) {
+    int inverse_symmetry = INVERSE_SYMMETRIES[symmetry];
+
+    for (uint32_t node_index = 0; node_index < tree.graph.size(); node_index++) {
+        Node& node = tree.graph[node_index];
+        if (node.last_move.row < BOARD_HEIGHT) node.last_move = transform_move<Geometry>(node.last_move, symmetry);
+
+        if (node.is_transposition()) {
+            tree.symmetries[node_index] = combine_symmetries(
+                    symmetry, combine_symmetries(tree.symmetries[node_index], inverse_symmetry));
+        } else if (node.children_end > node.children_start) {
+            tree.symmetries[node_index] = combine_symmetries(tree.symmetries[node_index], inverse_symmetry);
+        }
+    }
+
+    for (uint32_t edge_index = 0; edge_index < tree.edges.size(); edge_index++) {
+        Move move = transform_move<Geometry>(tree.edges[edge_index].get_move(), symmetry);
+        tree.edges[edge_index] = Edge{static_cast<uint8_t>(move.row), static_cast<uint8_t>(move.col)};
+    }
+}
 
-    auto start_size = tree.graph.size();
+/*
+ * Compacts the subtree of the new root to the front of the arena in place. Nodes that outgrow their children
+ * block move it to the end of the arena, so the subtree is marked first and then every live node slides down to
+ * its rank among the live nodes. Ranks keep the index order, so no live node is overwritten before it has been
+ * moved and every children block stays contiguous. Only the live nodes are touched, the rest of the old tree is
+ * dropped without being copied. The edges of the live nodes are then slid down the same way.
+ *
+ * The subtree is a DAG, the nodes that transpositions share their children with are live even when they were
+ * reached from outside of it, and their slots in the transposition table follow them. A root that shares its
+ * children with a rotation or reflection of itself is replaced by that node, and the tree is turned to the
+ * orientation of the position.
+ */
+template <typename Geometry>
+void MCTS<Geometry>::flatten_tree() {
+    uint32_t start_size = tree.graph.size();
+
+    // The root is searched from the node it shares its children with, turned to the orientation of the position
+    Move root_move = tree.graph[root_node_index].last_move;
+    int root_orientation = IDENTITY;
+    if (tree.graph[root_node_index].is_transposition()) {
+        root_orientation = tree.symmetries[root_node_index];
+        root_node_index = tree.find_transposition(tree.hash_keys[root_node_index]);
+    }
 
-    tree.graph.clear();
+    std::vector<uint64_t> live((start_size + 63) / 64);
+    std::vector<uint32_t> stack{root_node_index};
+    while (!stack.empty()) {
+        uint32_t node_index = stack.back();
+        stack.pop_back();
 
-    std::queue<std::pair<uint32_t, uint32_t>> next_nodes_index;
-    next_nodes_index.push({root_node_index, 0});
-    tree.graph.push_back(copy_graph[root_node_index]);
+        if (live[node_index / 64] & (1ULL << (node_index % 64))) continue;
+        live[node_index / 64] |= 1ULL << (node_index % 64);
 
-    root_node_index = 0;
+        Node& node = tree.graph[node_index];
+        if (node.is_transposition()) {
+            stack.push_back(tree.find_transposition(tree.hash_keys[node_index]));
+            continue;
+        }
 
-    tree.graph[0].parent = 0;
+        for (uint32_t child_index = node.children_start; child_index < node.children_end; child_index++) {
+            stack.push_back(child_index);
+        }
+    }
 
-    while (!next_nodes_index.empty()) {
-        auto current_node_index = next_nodes_index.front();
-        uint32_t old_node_index = current_node_index.first;
-        uint32_t new_node_index = current_node_index.second;
+    auto is_live = [&live](uint32_t node_index) {
+        return (live[node_index / 64] & (1ULL << (node_index % 64))) != 0;
+    };
 
-        Node& current_old_node = copy_graph[old_node_index];
-        Node& current_new_node = tree.graph[new_node_index];
+    // Live nodes before every word of the bitset, a node's new index is its rank among the live nodes
+    std::vector<uint32_t> ranks(live.size());
+    uint32_t new_size = 0;
+    for (uint32_t word = 0; word < live.size(); word++) {
+        ranks[word] = new_size;
+        new_size += __builtin_popcountll(live[word]);
+    }
 
-        current_new_node.children_start = tree.graph.size();
-        for (int i = 0; i < current_old_node.children_end - current_old_node.children_start; i++) {
-            tree.graph.push_back(copy_graph[current_old_node.children_start + i]);
-            tree.graph[tree.graph.size() - 1].parent = new_node_index;
+    auto get_new_index = [&live, &ranks](uint32_t old_index) {
+        uint64_t lower_bits = live[old_index / 64] & ((1ULL << (old_index % 64)) - 1);
+        return ranks[old_index / 64] + static_cast<uint32_t>(__builtin_popcountll(lower_bits));
+    };
+
+    // The old edges start and new index of every live node with children
+    std::vector<std::pair<uint32_t, uint32_t>> edge_blocks;
+
+    for (uint32_t word = 0; word < live.size(); word++) {
+        uint64_t bits = live[word];
+        while (bits) {
+            uint32_t old_index = word * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+
+            Node node = tree.graph[old_index];
+
+            // The root and nodes only reached through transpositions are their own parent
+            bool own_parent = old_index == root_node_index || !is_live(node.parent);
+            node.parent = get_new_index(own_parent ? old_index : node.parent);
+
+            // Leaves keep an empty children range starting at 0 so that tree parallel expansions can claim them
+            if (node.is_transposition()) {
+                node.move_count = 0;
+            } else if (node.children_end <= node.children_start) {
+                node.children_start = 0;
+                node.children_end = 0;
+                node.children_capacity = 0;
+                node.move_count = 0;
+            } else {
+                uint32_t n_children = node.children_end - node.children_start;
+                node.children_start = get_new_index(node.children_start);
+                node.children_end = node.children_start + n_children;
+                node.children_capacity = n_children;
+                edge_blocks.emplace_back(node.edges_start, get_new_index(old_index));
+            }
 
-            next_nodes_index.push({current_old_node.children_start + i, tree.graph.size() - 1});
+            uint32_t new_index = get_new_index(old_index);
+            tree.graph[new_index] = node;
+            tree.visits[new_index] = tree.visits[old_index];
+            tree.win_counts[new_index] = tree.win_counts[old_index];
+            tree.proofs[new_index] = tree.proofs[old_index];
+            tree.hash_keys[new_index] = tree.hash_keys[old_index];
+            tree.symmetries[new_index] = tree.symmetries[old_index];
         }
+    }
 
-        current_new_node.children_end = tree.graph.size();
+    for (uint32_t slot = 0; slot < tree.transposition_table.capacity(); slot++) {
+        uint32_t& node_index = tree.transposition_table[slot];
+        if (node_index != NO_NODE) node_index = is_live(node_index) ? get_new_index(node_index) : NO_NODE;
+    }
+
+    tree.graph.truncate(new_size);
+    root_node_index = get_new_index(root_node_index);
+
+    std::sort(edge_blocks.begin(), edge_blocks.end());
+
+    uint32_t new_edges_size = 0;
+    for (auto [edges_start, node_index] : edge_blocks) {
+        Node& node = tree.graph[node_index];
+        std::copy(&tree.edges[edges_start], &tree.edges[edges_start] + node.move_count, &tree.edges[new_edges_size]);
+        std::copy(&tree.priors[edges_start], &tree.priors[edges_start] + node.move_count, &tree.priors[new_edges_size]);
 
-        next_nodes_index.pop();
+        node.edges_start = new_edges_size;
+        new_edges_size += node.move_count;
     }
 
+    tree.edges.truncate(new_edges_size);
+
+    if (root_orientation != IDENTITY) reorient_tree(root_orientation);
+    tree.graph[root_node_index].last_move = root_move;
+
     /*
     std::queue<uint32_t> new_node_index;
     new_node_index.push(root_node_index);
@@ -380,5 +1276,11 @@ void MCTS::flatten_tree() {
     }
     */
 
-    std::cout << "Tree flattened from " << start_size << " to " << tree.graph.size() << std::endl;
-}
\ No newline at end of file
+    std::cout << "Tree flattened from " << start_size << " to " << new_size << std::endl;
+}
+
+// One instance for every geometry in constants.h
+template class MCTS<TicTacToe>;
+template class MCTS<ConnectFour>;
+template class MCTS<Gomoku>;
+template class MCTS<Gomoku19>;
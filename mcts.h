@@ -5,68 +5,383 @@
 #ifndef MCTS_MNK_MCTS_H
 #define MCTS_MNK_MCTS_H
 
-#include <thread>
+#include <atomic>
+#include <bit>
+#include <memory>
 #include "constants.h"
 #include "position.h"
 #include "fixed_vector.h"
+#include "thread_pool.h"
+#include "arena.h"
+#include "puct.h"
+#include "random.h"
+#include "negamax.h"
 
+// Sentinel children_start of a node that is being expanded by another thread
+constexpr uint32_t EXPANDING = UINT32_MAX;
+
+// children_start and children_end of a transposition, a node whose position was expanded through another move order.
+// Its children are the ones of the node that the transposition table holds for its position.
+constexpr uint32_t TRANSPOSITION = UINT32_MAX - 1;
+
+// An empty slot of the transposition table
+constexpr uint32_t NO_NODE = UINT32_MAX;
+
+// The proof of a node the solver hasn't decided yet, a decided node stores its result + 1
+constexpr uint8_t UNPROVEN = 0;
+
+// Priors are stored quantized, MAX_PRIOR is the prior of the best move of its parent
+constexpr uint16_t MAX_PRIOR = UINT16_MAX;
+
+// A legal move of an expanded node, a node's edges are sorted by prior and its children are created in that order
+struct Edge {
+    uint8_t row = 0;
+    uint8_t col = 0;
+
+    inline Move get_move() { return Move{row, col}; }
+};
+
+// The structure of the tree, the statistics of a node are kept by Tree
 class Node {
 public:
     uint32_t parent = 0;
     uint32_t children_start = 0;
     uint32_t children_end = 0;
-    int win_count = 0;
-    int visits = 1;
     Move last_move;
 
+    // Child i is the node of edge i, only the first children_end - children_start edges have one
+    uint32_t edges_start = 0;
+    uint16_t move_count = 0;
+    uint16_t children_capacity = 0;
+
     Node(uint32_t c_parent, Move c_last_move) {
         parent = c_parent;
-        win_count = 0;
-        visits = 1;
         last_move = c_last_move;
     }
-};
 
+    // children_start is published before children_end, so it is valid whenever this returns a non-zero end
+    inline uint32_t get_children_end() {
+        return std::atomic_ref<uint32_t>(children_end).load(std::memory_order_acquire);
+    }
 
+    inline uint32_t get_children_start() {
+        return std::atomic_ref<uint32_t>(children_start).load(std::memory_order_relaxed);
+    }
+
+    inline bool is_transposition() {
+        return get_children_end() == TRANSPOSITION;
+    }
+};
+
+/*
+ * The statistics of the nodes and the priors of the edges are kept in arrays indexed like graph and edges, so the
+ * statistics and priors of a block of siblings are contiguous for select_puct. Only graph and edges track their size.
+ *
+ * In tree parallel searches several threads update the same statistics, so they are only accessed through
+ * atomic_refs. This keeps Node trivially copyable for flatten_tree.
+ *
+ * The transposition table maps the canonical Zobrist key of a position to the node that expanded it, so the tree is
+ * a DAG: other nodes of the same position, or of a rotation or reflection of it, become transpositions and share that
+ * node's children. hash_keys and symmetries are only set for expanded nodes and transpositions. The table is direct
+ * mapped, a slot keeps the first node stored in it.
+ *
+ * proofs holds the result of every node whose position the solver has proven, select_puct skips those children.
+ *
+ * The moves below a node are in the orientation of the node that expanded its block. For an expanded node symmetries
+ * holds the symmetry from its orientation to the canonical one, for a transposition the symmetry from the orientation
+ * of the node it shares its children with to its own.
+ */
 class Tree {
 public:
-    std::vector<Node> graph{};
+    // Allocated once with the memory budget, expansions stop when it is full and the search keeps simulating
+    Arena<Node> graph{};
+    Arena<int> visits{};
+    Arena<int> win_counts{};
+    Arena<uint64_t> hash_keys{};
+    Arena<uint8_t> symmetries{};
+    Arena<uint8_t> proofs{};
+    Arena<uint32_t> transposition_table{};
+
+    Arena<Edge> edges{};
+    Arena<uint16_t> priors{};
+
+    static constexpr size_t NODE_BYTES = sizeof(Node) + 2 * sizeof(int) + sizeof(uint64_t) + 2 * sizeof(uint8_t);
+
+    // The table gets at most one slot for every node
+    static constexpr size_t TRANSPOSITION_BYTES = sizeof(uint32_t);
+    static constexpr size_t EDGE_BYTES = sizeof(Edge) + sizeof(uint16_t);
+
+    static uint32_t get_capacity(size_t bytes, size_t element_bytes) {
+        return static_cast<uint32_t>(std::min<size_t>(bytes / element_bytes, ARENA_FULL - 1));
+    }
+
+    // The number of nodes and of edges that allocate fits in the budgets
+    static uint32_t get_node_capacity(size_t node_bytes) {
+        return get_capacity(node_bytes, NODE_BYTES + TRANSPOSITION_BYTES);
+    }
+
+    static uint32_t get_edge_capacity(size_t edge_bytes) {
+        return get_capacity(edge_bytes, EDGE_BYTES);
+    }
+
+    void allocate(size_t node_bytes, size_t edge_bytes, bool use_huge_pages) {
+        uint32_t node_capacity = get_node_capacity(node_bytes);
+        graph.allocate_elements(node_capacity, use_huge_pages);
+        visits.allocate_elements(node_capacity, use_huge_pages);
+        win_counts.allocate_elements(node_capacity, use_huge_pages);
+        hash_keys.allocate_elements(node_capacity, use_huge_pages);
+        symmetries.allocate_elements(node_capacity, use_huge_pages);
+        proofs.allocate_elements(node_capacity, use_huge_pages);
+
+        transposition_table.allocate_elements(std::bit_floor(std::max<uint32_t>(node_capacity, 1)), use_huge_pages);
+        clear_transpositions();
+
+        uint32_t edge_capacity = get_edge_capacity(edge_bytes);
+        edges.allocate_elements(edge_capacity, use_huge_pages);
+        priors.allocate_elements(edge_capacity, use_huge_pages);
+    }
+
+    void swap(Tree& other) {
+        graph.swap(other.graph);
+        visits.swap(other.visits);
+        win_counts.swap(other.win_counts);
+        hash_keys.swap(other.hash_keys);
+        symmetries.swap(other.symmetries);
+        proofs.swap(other.proofs);
+        transposition_table.swap(other.transposition_table);
+        edges.swap(other.edges);
+        priors.swap(other.priors);
+    }
+
+    inline void clear() {
+        graph.clear();
+        edges.clear();
+        clear_transpositions();
+    }
+
+    inline void clear_transpositions() {
+        std::fill(&transposition_table[0], &transposition_table[0] + transposition_table.capacity(), NO_NODE);
+    }
+
+    inline uint32_t& get_transposition_slot(uint64_t hash_key) {
+        return transposition_table[hash_key & (transposition_table.capacity() - 1)];
+    }
+
+    // The expanded node of the position, or NO_NODE if the table doesn't hold one
+    inline uint32_t find_transposition(uint64_t hash_key) {
+        uint32_t node_index = std::atomic_ref<uint32_t>(get_transposition_slot(hash_key))
+                .load(std::memory_order_acquire);
+
+        if (node_index == NO_NODE || hash_keys[node_index] != hash_key) return NO_NODE;
+        return node_index;
+    }
+
+    // Only called once the node's children are published, so a thread that finds the node also sees them
+    inline void store_transposition(uint64_t hash_key, uint32_t node_index) {
+        uint32_t expected = NO_NODE;
+        std::atomic_ref<uint32_t>(get_transposition_slot(hash_key))
+                .compare_exchange_strong(expected, node_index, std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    // Points the table at the new copy of a node whose children block was moved
+    inline void move_transposition(uint32_t old_index, uint32_t new_index) {
+        uint32_t& slot = get_transposition_slot(hash_keys[old_index]);
+        if (slot == old_index) slot = new_index;
+    }
+
+    inline void create_node(uint32_t node_index, uint32_t parent, Move last_move) {
+        new (&graph[node_index]) Node(parent, last_move);
+        visits[node_index] = 1;
+        win_counts[node_index] = 0;
+        proofs[node_index] = UNPROVEN;
+    }
+
+    inline void copy_node(uint32_t node_index, uint32_t source_index) {
+        graph[node_index] = graph[source_index];
+        visits[node_index] = visits[source_index];
+        win_counts[node_index] = win_counts[source_index];
+        hash_keys[node_index] = hash_keys[source_index];
+        symmetries[node_index] = symmetries[source_index];
+        proofs[node_index] = proofs[source_index];
+    }
+
+    inline uint32_t emplace_back(uint32_t parent, Move last_move) {
+        uint32_t node_index = graph.claim(1);
+        if (node_index != ARENA_FULL) create_node(node_index, parent, last_move);
+
+        return node_index;
+    }
+
+    inline int get_visits(uint32_t node_index) {
+        return std::atomic_ref<int>(visits[node_index]).load(std::memory_order_relaxed);
+    }
+
+    inline int get_win_count(uint32_t node_index) {
+        return std::atomic_ref<int>(win_counts[node_index]).load(std::memory_order_relaxed);
+    }
+
+    // The proven result of the node's position, or NO_SCORE
+    inline int get_proven_result(uint32_t node_index) {
+        uint8_t proof = std::atomic_ref<uint8_t>(proofs[node_index]).load(std::memory_order_relaxed);
+        return proof == UNPROVEN ? NO_SCORE : proof - 1;
+    }
+
+    inline void set_proven_result(uint32_t node_index, int result) {
+        std::atomic_ref<uint8_t>(proofs[node_index]).store(static_cast<uint8_t>(result + 1), std::memory_order_relaxed);
+    }
+
+    inline void add_statistics(uint32_t node_index, int visits_delta, int win_count_delta) {
+        std::atomic_ref<int>(visits[node_index]).fetch_add(visits_delta, std::memory_order_relaxed);
+        std::atomic_ref<int>(win_counts[node_index]).fetch_add(win_count_delta, std::memory_order_relaxed);
+    }
+};
+
+// A node selected by a thread, for a transposition with the node whose children were searched from it
+struct PathNode {
+    uint32_t node_index = 0;
+    uint32_t children_node_index = 0;
+};
+
+// Everything a thread needs to walk the tree on its own copy of the position
+template <typename Geometry>
+class SearchThread {
+public:
+    Position<Geometry> position{};
+
+    PLY_TYPE ply = 0;
+    PLY_TYPE seldepth = 0;
+    int simulation_value = 0;  // The result of the thread's last rollout for white, in RESULT_UNITS
+
+    Random random{};
+
+    // The symmetry from the orientation of the moves of the current node to the position's
+    int orientation = IDENTITY;
+
+    std::array<State, Geometry::MAX_DEPTH> state_stack{};
+
+    // The nodes of the current iteration by ply, back propagation follows them since a node can have several parents
+    std::array<PathNode, Geometry::MAX_DEPTH> path{};
+    FixedVector<Move, Geometry::MAX_MOVES> move_vector{};
+    FixedVector<uint16_t, Geometry::MAX_MOVES> priors{};
+
+    // Searches new leaves for forced wins when the solver is on
+    Engine<Geometry> engine{};
+};
+
+// Statistics of the root's children indexed by their move, published by root parallel trees
+template <typename Geometry>
+struct RootStatistics {
+    int visits[Geometry::BOARD_HEIGHT][Geometry::BOARD_WIDTH]{};
+    int win_counts[Geometry::BOARD_HEIGHT][Geometry::BOARD_WIDTH]{};
+    uint8_t proofs[Geometry::BOARD_HEIGHT][Geometry::BOARD_WIDTH]{};
+};
+
+// What a root move is reported with, its node's statistics and the votes of the root parallel helpers for its move
+struct MoveStatistics {
+    int visits = 0;
+    int win_count = 0;
+    int proven_result = NO_SCORE;
 };
 
+template <typename Geometry>
 class MCTS {
 public:
-    MCTS() = default;
+    static constexpr int BOARD_HEIGHT = Geometry::BOARD_HEIGHT;
+    static constexpr int BOARD_WIDTH = Geometry::BOARD_WIDTH;
+    static constexpr int WIN_AMT = Geometry::WIN_AMT;
+    static constexpr int MAX_MOVES = Geometry::MAX_MOVES;
+    static constexpr PLY_TYPE MAX_SIMULATION_DEPTH = Geometry::MAX_SIMULATION_DEPTH;
+    static constexpr PLY_TYPE MAX_DEPTH = Geometry::MAX_DEPTH;
+    static constexpr Move NO_MOVE = Geometry::NO_MOVE;
+
+    MCTS() : MCTS(DEFAULT_TREE_MEMORY_MB * 1024 * 1024, false) {}
 
-    Threats current_threats{};
+    MCTS(size_t tree_bytes, bool use_huge_pages) {
+        tree_memory = tree_bytes;
+        huge_pages = use_huge_pages;
+        tree.allocate(get_tree_bytes() - get_edge_bytes(), get_edge_bytes(), huge_pages);
+        set_threads(DEFAULT_THREADS);
+    }
 
-    Position position{};
+    Position<Geometry> position{};
 
     uint64_t start_time = 0;
     PLY_TYPE seldepth = 0;
-    PLY_TYPE ply = 0;
-    int iterations = 0;
-    int simulation_results[THREADS]{};
-    std::thread simulation_threads[THREADS]{};
+    std::atomic<int> iterations = 0;
+
+    uint64_t seed = DEFAULT_SEED;
+    int search_mode = LEAF_PARALLEL;
+    int expansion_mode = FULL_EXPANSION;
+    bool transpositions = true;
+    int solver_mode = SOLVER_OFF;
+    int rollout_depth = FULL_ROLLOUTS;
+    size_t tree_memory = DEFAULT_TREE_MEMORY_MB * 1024 * 1024;
+    bool huge_pages = false;
+    int virtual_loss = 0;
+    std::atomic<bool> stopped = false;
+
+    // Thread 0 is the thread that called search, the rest are pool helpers
+    ThreadPool thread_pool{};
+    std::vector<SearchThread<Geometry>> search_threads{};
 
     uint32_t root_node_index = 0;
 
     Tree tree{};
 
-    std::array<State, MAX_DEPTH> state_stack{};
-    std::array<Position, THREADS> test_positions{};
-    std::array<FixedVector<Move, MAX_MOVES>, THREADS> move_vectors{};
+    // The independent searches run by the helpers in root parallel mode, helper i owns root_searchers[i - 1]
+    std::vector<std::unique_ptr<MCTS>> root_searchers{};
+    RootStatistics<Geometry> published_root_statistics{};
+
+    void set_threads(int threads);
+    void set_seed(uint64_t new_seed);
+    void set_search_mode(int mode);
+    void set_tree_memory(size_t bytes, bool use_huge_pages);
+    size_t get_tree_bytes();
+    size_t get_edge_bytes();
+    void allocate_trees();
 
+    static double get_win_probability(int win_count, int visits);
     double get_win_probability(uint32_t node_index);
-    void descend_to_root(uint32_t node_index);
+    void descend_to_root(SearchThread<Geometry>& thread);
+    int make_tree_move(SearchThread<Geometry>& thread, uint32_t node_index);
+    uint32_t resolve_transposition(SearchThread<Geometry>& thread, uint32_t node_index);
+
+    static double get_policy(Position<Geometry>& position, Move move);
+    static int evaluate(Position<Geometry>& position);
+    static int get_result_value(int result);
+    static int generate_children(SearchThread<Geometry>& thread);
+    static uint32_t get_widening_width(int visits);
+    uint32_t get_width(uint32_t node_index);
+    uint32_t add_child(uint32_t node_index);
 
     uint32_t select_best_child(uint32_t node_index);
-    uint32_t selection();
-    void expansion(uint32_t node_index);
-    void simulation(uint32_t node_index, int thread_id);
-    void back_propagation(uint32_t node_index, int result);
+    uint32_t selection(SearchThread<Geometry>& thread, int& leaf_result);
+    bool expansion(SearchThread<Geometry>& thread, uint32_t node_index);
+    void simulation(SearchThread<Geometry>& thread);
+    void back_propagation(SearchThread<Geometry>& thread, int value);
+    int get_children_result(uint32_t node_index, int side);
+    void prove(SearchThread<Geometry>& thread, int result);
+    bool is_solved();
+    bool is_solved_by_helper();
     uint32_t get_best_node();
+
+    void publish_root_statistics();
+    void add_root_statistics(RootStatistics<Geometry>& statistics);
+    RootStatistics<Geometry> get_helper_statistics();
+    MoveStatistics get_move_statistics(uint32_t node_index, RootStatistics<Geometry>& helper_statistics);
+    MoveStatistics get_move_statistics(uint32_t node_index);
+    void prepare_root_searchers();
+    void merge_root_statistics();
+
+    void leaf_parallel_iteration(SearchThread<Geometry>& thread);
+    void tree_parallel_iteration(SearchThread<Geometry>& thread);
+    void parallel_iteration(int thread_id, int iteration);
+    bool check_time(int iteration);
+    void print_progress(int iteration);
     uint32_t search();
 
+    void rebuild_transpositions();
+    void reorient_tree(int symmetry);
     void flatten_tree();
 };
 
@@ -0,0 +1,64 @@
+#ifndef MCTS_MNK_MOVE_SET_H
+#define MCTS_MNK_MOVE_SET_H
+
+#include <cstdint>
+#include "constants.h"
+#include "fixed_vector.h"
+
+/*
+ * A fixed capacity set of board squares that never allocates. The moves are kept densely in a FixedVector
+ * and every square maps to its index in it, so insert, erase and contains are all O(1) and
+ * iteration only touches the members.
+ */
+template <typename Geometry>
+class MoveSet {
+
+private:
+    static constexpr uint16_t NO_INDEX = UINT16_MAX;
+
+    FixedVector<Move, Geometry::MAX_MOVES> moves{};
+    uint16_t indices[Geometry::BOARD_HEIGHT][Geometry::BOARD_WIDTH]{};
+
+public:
+    MoveSet() {
+        for (auto& row : indices) {
+            for (uint16_t& index : row) {
+                index = NO_INDEX;
+            }
+        }
+    }
+
+    inline size_t size() { return moves.size(); }
+    inline bool empty() { return moves.empty(); }
+
+    inline auto begin() { return moves.begin(); }
+    inline auto end() { return moves.end(); }
+
+    inline Move& operator[](size_t index) { return moves[index]; }
+
+    inline bool contains(Move move) const { return indices[move.row][move.col] != NO_INDEX; }
+
+    inline void insert(Move move) {
+        if (contains(move)) return;
+
+        indices[move.row][move.col] = static_cast<uint16_t>(moves.size());
+        moves.push_back(move);
+    }
+
+    inline void erase(Move move) {
+        uint16_t index = indices[move.row][move.col];
+        if (index == NO_INDEX) return;
+
+        // Swap the last member into the hole so the moves stay dense
+        Move last = moves.pop();
+        if (index != moves.size()) {
+            moves[index] = last;
+            indices[last.row][last.col] = index;
+        }
+
+        indices[move.row][move.col] = NO_INDEX;
+    }
+};
+
+
+#endif //MCTS_MNK_MOVE_SET_H
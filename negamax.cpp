@@ -3,3 +3,240 @@
 //
 
 #include "negamax.h"
+
+// Table keys of the same position searched for the other attacker or in the other mode
+constexpr uint64_t BLACK_ATTACKER_KEY = 0x9E6C63D0676A9A99ULL;
+constexpr uint64_t VCT_KEY = 0x2F1B8C4E7D3A5960ULL;
+
+template <typename Geometry>
+uint64_t Engine<Geometry>::get_table_key(Position<Geometry>& position) {
+    return position.get_hash_key() ^ (attacker == BLACK ? BLACK_ATTACKER_KEY : 0) ^ (mode == SOLVER_VCT ? VCT_KEY : 0);
+}
+
+// The strongest pattern the move makes for the colour along any line, and the prior of the move from its patterns
+template <typename Geometry>
+int Engine<Geometry>::get_best_pattern(Position<Geometry>& position, int color, Move move, int& score) {
+    uint8_t best = PATTERN_DEAD;
+    score = 0;
+
+    for (int direction = 0; direction < 4; direction++) {
+        uint8_t pattern = position.get_pattern(color, direction, move.row, move.col);
+        best = std::max(best, pattern);
+        score += 1 << (2 * pattern);
+    }
+
+    return best;
+}
+
+/*
+ * Appends the moves that give the colour a four, and with threes also the ones that give it an open three, scored
+ * by their patterns so that two fours and open fours go first.
+ */
+template <typename Geometry>
+void Engine<Geometry>::get_threat_moves(Position<Geometry>& position, int color, bool threes,
+                                        FixedVector<ScoredMove, MAX_MOVES>& moves) {
+    size_t existing = moves.size();
+    uint8_t needed = threes ? PATTERN_OPEN_THREE : PATTERN_FOUR;
+
+    // A four can be a gap away from the colour's stones, so every empty square is looked up
+    for (uint16_t row = 0; row < BOARD_HEIGHT; row++) {
+        for (uint16_t col = 0; col < BOARD_WIDTH; col++) {
+            Move move{row, col};
+            int score;
+            if (!position.is_empty(row, col) || get_best_pattern(position, color, move, score) < needed) continue;
+
+            bool duplicate = false;
+            for (size_t i = 0; i < existing; i++) duplicate |= moves[i].move == move;
+            if (!duplicate) moves.push_back(ScoredMove{move, score});
+        }
+    }
+}
+
+/*
+ * The defender's answers to the attacker's threes: every square of the line windows of the attacker's threats_2
+ * squares whose stone would weaken their pattern, the threat squares themselves, and the defender's own fours.
+ * Any other move leaves the attacker a four that can't be blocked.
+ */
+template <typename Geometry>
+void Engine<Geometry>::get_defences(Position<Geometry>& position, FixedVector<ScoredMove, MAX_MOVES>& moves) {
+    constexpr int CENTER = LinePatterns<WIN_AMT>::CENTER;
+    bool added[BOARD_HEIGHT][BOARD_WIDTH]{};
+
+    auto add_defence = [&](uint16_t row, uint16_t col, int score) {
+        if (added[row][col]) return;
+        added[row][col] = true;
+        moves.push_back(ScoredMove{Move{row, col}, score});
+    };
+
+    for (Move threat : position.threats.threats_2[attacker]) {
+        add_defence(threat.row, threat.col, 1 << 16);
+
+        for (int direction = 0; direction < 4; direction++) {
+            uint16_t code = position.line_codes[attacker][direction][threat.row][threat.col];
+            uint8_t pattern = LINE_PATTERNS<WIN_AMT>.classes[code];
+            if (pattern < PATTERN_FOUR) continue;
+
+            for (int cell = 0; cell < LinePatterns<WIN_AMT>::CELLS; cell++) {
+                int row = threat.row + (cell - CENTER) * UNIQUE_INCREMENTS[direction].row;
+                int col = threat.col + (cell - CENTER) * UNIQUE_INCREMENTS[direction].col;
+                if (cell == CENTER || row < 0 || row >= BOARD_HEIGHT || col < 0 || col >= BOARD_WIDTH) continue;
+                if (position.board[row][col] != EMPTY) continue;
+
+                int blocked_code = code + CELL_BLOCKED * LinePatterns<WIN_AMT>::CELL_WEIGHTS[cell];
+                if (LINE_PATTERNS<WIN_AMT>.classes[blocked_code] < pattern) {
+                    add_defence(static_cast<uint16_t>(row), static_cast<uint16_t>(col), 1 << 15);
+                }
+            }
+        }
+    }
+
+    get_threat_moves(position, attacker ^ 1, false, moves);
+}
+
+template <typename Geometry>
+int Engine<Geometry>::negamax(Position<Geometry>& position, int alpha, int beta, int depth, PLY_TYPE ply) {
+    if (++nodes >= max_nodes) {
+        aborted = true;
+        return 0;
+    }
+
+    int side = position.side;
+    int opp_side = side ^ 1;
+    bool attacking = side == attacker;
+    Threats<Geometry>& threats = position.threats;
+
+    // A five on the next move wins, two fours of the opponent can't both be blocked
+    if (!threats.threats_1[side].empty()) {
+        if (ply == 0) best_move = *threats.threats_1[side].begin();
+        return MATE_SCORE - ply;
+    }
+
+    if (threats.threats_1[opp_side].size() >= 2) return -(MATE_SCORE - ply - 1);
+
+    // A four of the opponent has to be blocked, the attacker still needs a move left to do it
+    bool forced = threats.threats_1[opp_side].size() == 1;
+    if (attacking && depth <= 0) {
+        depth_limited = true;
+        return 0;
+    }
+
+    // The defender is free once the attacker runs out of threats
+    if (!attacking && !forced && threats.threats_2[attacker].empty()) return 0;
+    if (ply >= MAX_PLY) return 0;
+
+    uint64_t key = get_table_key(position);
+    SolverEntry& entry = transposition_table[key & (SOLVER_TABLE_ENTRIES - 1)];
+    Move table_move = Geometry::NO_MOVE;
+
+    if (entry.key == key) {
+        table_move = entry.move;
+
+        int score = entry.score;
+        if (score >= MATE_BOUND) score -= ply;
+        else if (score <= -MATE_BOUND) score += ply;
+
+        if (ply != 0 && entry.depth >= depth && (entry.bound == EXACT_BOUND ||
+            (entry.bound == LOWER_BOUND && score >= beta) || (entry.bound == UPPER_BOUND && score <= alpha))) {
+            return score;
+        }
+    }
+
+    FixedVector<ScoredMove, MAX_MOVES>& moves = move_stack[ply];
+    moves.clear();
+
+    if (forced) moves.push_back(ScoredMove{*threats.threats_1[opp_side].begin(), 0});
+    else if (attacking) get_threat_moves(position, side, mode == SOLVER_VCT, moves);
+    else get_defences(position, moves);
+
+    if (moves.empty()) return 0;
+
+    for (ScoredMove& scored_move : moves) {
+        if (scored_move.move == table_move) scored_move.score = SCORE_INFINITY;
+    }
+
+    // The attacker can always stop attacking, which leaves the position unsolved
+    int original_alpha = alpha;
+    int best_score = attacking && !forced ? 0 : -SCORE_INFINITY;
+    Move best = Geometry::NO_MOVE;
+    bool cutoff = false;
+
+    alpha = std::max(alpha, best_score);
+    if (alpha >= beta) return best_score;
+
+    for (size_t i = 0; i < moves.size(); i++) {
+
+        // Sorted as they are tried, a cutoff usually comes long before the end of the list
+        for (size_t j = i + 1; j < moves.size(); j++) {
+            if (moves[j].score > moves[i].score) std::swap(moves[i], moves[j]);
+        }
+
+        Move move = moves[i].move;
+        position.template make_move<MOVE_ADJACENCY>(move);
+        int score = -negamax(position, -beta, -alpha, depth - attacking, ply + 1);
+        position.template undo_move<MOVE_ADJACENCY>(move);
+
+        if (aborted) return 0;
+
+        if (score > best_score) {
+            best_score = score;
+            best = move;
+            if (ply == 0) best_move = move;
+
+            // Any proof will do, there is no need to look for a shorter one
+            if (score > alpha) alpha = score;
+            if (alpha >= beta || score >= MATE_BOUND) {
+                cutoff = true;
+                break;
+            }
+        }
+    }
+
+    entry.key = key;
+    entry.score = static_cast<int16_t>(best_score >= MATE_BOUND ? best_score + ply :
+                                       best_score <= -MATE_BOUND ? best_score - ply : best_score);
+    entry.depth = static_cast<int8_t>(depth);
+    entry.bound = cutoff ? LOWER_BOUND : best_score > original_alpha ? EXACT_BOUND : UPPER_BOUND;
+    entry.move = best;
+
+    return best_score;
+}
+
+/*
+ * Searches the position for a forced win of the side to move, returns the winner once one side is proven to win
+ * and NO_SCORE otherwise. best_move is the attacker's first move of the proof.
+ */
+template <typename Geometry>
+int Engine<Geometry>::solve(Position<Geometry>& position, int max_depth, uint64_t node_limit) {
+    if (transposition_table.empty()) {
+        transposition_table.resize(SOLVER_TABLE_ENTRIES);
+        move_stack.resize(MAX_PLY + 1);
+    }
+
+    attacker = position.side;
+    max_nodes = node_limit;
+    nodes = 0;
+    aborted = false;
+    best_move = Geometry::NO_MOVE;
+    completed_depth = 0;
+
+    for (int iteration_depth = 1; iteration_depth <= std::min(max_depth, MAX_SOLVER_DEPTH); iteration_depth++) {
+        depth_limited = false;
+        int score = negamax(position, -SCORE_INFINITY, SCORE_INFINITY, iteration_depth, 0);
+        if (aborted) break;
+
+        completed_depth = iteration_depth;
+        if (score >= MATE_BOUND) return attacker;
+        if (score <= -MATE_BOUND) return attacker ^ 1;
+
+        // Every line ran out of threats before the depth did, searching deeper finds nothing new
+        if (!depth_limited) break;
+    }
+
+    return NO_SCORE;
+}
+
+// One instance for every geometry in constants.h
+template class Engine<TicTacToe>;
+template class Engine<ConnectFour>;
+template class Engine<Gomoku>;
+template class Engine<Gomoku19>;
@@ -5,16 +5,78 @@
 #ifndef MCTS_MNK_NEGAMAX_H
 #define MCTS_MNK_NEGAMAX_H
 
+#include <algorithm>
+#include <vector>
 #include "constants.h"
 #include "position.h"
 
+// A win in n plies scores MATE_SCORE - n, every score beyond MATE_BOUND is a proven result
+constexpr int MATE_SCORE = 30000;
+constexpr int MATE_BOUND = MATE_SCORE - 1000;
+constexpr int SCORE_INFINITY = MATE_SCORE + 1;
+
+constexpr uint8_t NO_BOUND    = 0;
+constexpr uint8_t EXACT_BOUND = 1;
+constexpr uint8_t LOWER_BOUND = 2;
+constexpr uint8_t UPPER_BOUND = 3;
+
+constexpr size_t SOLVER_TABLE_ENTRIES = 1 << 16;
+
+struct SolverEntry {
+    uint64_t key = 0;
+    int16_t score = 0;
+    int8_t depth = 0;
+    uint8_t bound = NO_BOUND;
+    Move move{};
+};
+
+struct ScoredMove {
+    Move move{};
+    int score = 0;
+};
+
+/*
+ * An alpha-beta threat-space solver. The attacker, the side to move at the root, only plays moves that make a four
+ * (VCF) or also moves that make a three (VCT), and the defender only answers them: a four has to be blocked, and a
+ * three is met by taking one of the squares it needs or by a four of the defender's own. Every other defence loses
+ * to the open four, so a win found this way is a proof. An attacker out of threats scores 0, which only means that
+ * no win was found.
+ *
+ * The search deepens one attacker move at a time, and a transposition table keyed on the position, the attacker
+ * and the mode carries bounds and best moves between iterations and searches.
+ */
+template <typename Geometry>
 class Engine {
+    static constexpr int BOARD_HEIGHT = Geometry::BOARD_HEIGHT;
+    static constexpr int BOARD_WIDTH = Geometry::BOARD_WIDTH;
+    static constexpr int WIN_AMT = Geometry::WIN_AMT;
+    static constexpr int MAX_MOVES = Geometry::MAX_MOVES;
+    static constexpr int MAX_PLY = 2 * MAX_SOLVER_DEPTH + 2;
+
+    std::vector<SolverEntry> transposition_table{};
+    std::vector<FixedVector<ScoredMove, MAX_MOVES>> move_stack{};
+
+    int attacker = WHITE;
+    uint64_t max_nodes = MAX_SOLVER_NODES;
+    bool aborted = false;
+    bool depth_limited = false;
+
+    uint64_t get_table_key(Position<Geometry>& position);
+    int get_best_pattern(Position<Geometry>& position, int color, Move move, int& score);
+    void get_threat_moves(Position<Geometry>& position, int color, bool threes,
+                          FixedVector<ScoredMove, MAX_MOVES>& moves);
+    void get_defences(Position<Geometry>& position, FixedVector<ScoredMove, MAX_MOVES>& moves);
+
 public:
-    Move best_move;
+    int mode = SOLVER_VCF;
 
-};
+    Move best_move = Geometry::NO_MOVE;
+    uint64_t nodes = 0;
+    int completed_depth = 0;
 
-int negamax(Position position, int alpha, int beta, int depth);
+    int negamax(Position<Geometry>& position, int alpha, int beta, int depth, PLY_TYPE ply);
+    int solve(Position<Geometry>& position, int max_depth, uint64_t node_limit);
+};
 
 
 #endif //MCTS_MNK_NEGAMAX_H
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include "nnue.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NNUE_X86
+#endif
+
+static void add_column_scalar(int16_t* values, const int16_t* column) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) values[i] = static_cast<int16_t>(values[i] + column[i]);
+}
+
+static void subtract_column_scalar(int16_t* values, const int16_t* column) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) values[i] = static_cast<int16_t>(values[i] - column[i]);
+}
+
+static void clip_scalar(const int16_t* values, uint8_t* activations) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        activations[i] = static_cast<uint8_t>(std::clamp<int>(values[i], 0, NNUE_ACTIVATION_SCALE));
+    }
+}
+
+static int32_t dot_scalar(const uint8_t* activations, const int8_t* weights) {
+    int32_t sum = 0;
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i++) sum += activations[i] * weights[i];
+    return sum;
+}
+
+#ifdef NNUE_X86
+
+__attribute__((target("avx2")))
+static void add_column_avx2(int16_t* values, const int16_t* column) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i lane_values = _mm256_load_si256(reinterpret_cast<__m256i*>(values + i));
+        __m256i lane_column = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(values + i), _mm256_add_epi16(lane_values, lane_column));
+    }
+}
+
+__attribute__((target("avx2")))
+static void subtract_column_avx2(int16_t* values, const int16_t* column) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i lane_values = _mm256_load_si256(reinterpret_cast<__m256i*>(values + i));
+        __m256i lane_column = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(column + i));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(values + i), _mm256_sub_epi16(lane_values, lane_column));
+    }
+}
+
+__attribute__((target("avx2")))
+static void clip_avx2(const int16_t* values, uint8_t* activations) {
+    __m256i maximum = _mm256_set1_epi8(NNUE_ACTIVATION_SCALE);
+
+    for (int i = 0; i < NNUE_HIDDEN; i += 32) {
+        __m256i low = _mm256_load_si256(reinterpret_cast<const __m256i*>(values + i));
+        __m256i high = _mm256_load_si256(reinterpret_cast<const __m256i*>(values + i + 16));
+
+        // packus saturates to [0, 255] and interleaves the 128 bit halves of its inputs, the permute undoes that
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0b11011000);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(activations + i), _mm256_min_epu8(packed, maximum));
+    }
+}
+
+__attribute__((target("avx2")))
+static int32_t dot_avx2(const uint8_t* activations, const int8_t* weights) {
+    __m256i ones = _mm256_set1_epi16(1);
+    __m256i sums = _mm256_setzero_si256();
+
+    // Activations are at most 127, so the pairwise sums of maddubs can't saturate
+    for (int i = 0; i < 2 * NNUE_HIDDEN; i += 32) {
+        __m256i lane_activations = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(activations + i));
+        __m256i lane_weights = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(weights + i));
+        __m256i products = _mm256_madd_epi16(_mm256_maddubs_epi16(lane_activations, lane_weights), ones);
+        sums = _mm256_add_epi32(sums, products);
+    }
+
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b01001110));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0b10110001));
+    return _mm_cvtsi128_si32(sum);
+}
+
+#endif
+
+struct NnueKernels {
+    void (*add_column)(int16_t*, const int16_t*);
+    void (*subtract_column)(int16_t*, const int16_t*);
+    void (*clip)(const int16_t*, uint8_t*);
+    int32_t (*dot)(const uint8_t*, const int8_t*);
+    const char* name;
+};
+
+static NnueKernels choose_nnue_kernels() {
+#ifdef NNUE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {add_column_avx2, subtract_column_avx2, clip_avx2, dot_avx2, "avx2"};
+    }
+#endif
+
+    return {add_column_scalar, subtract_column_scalar, clip_scalar, dot_scalar, "scalar"};
+}
+
+static const NnueKernels nnue_kernels = choose_nnue_kernels();
+
+const char* get_nnue_kernel_name() {
+    return nnue_kernels.name;
+}
+
+template <typename T>
+static bool read_values(std::ifstream& file, std::vector<T>& values, size_t count) {
+    values.resize(count);
+    file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(count * sizeof(T)));
+    return static_cast<bool>(file);
+}
+
+// Loads a weight file for this geometry, returns false and leaves no network loaded if it doesn't fit
+template <typename Geometry>
+bool Network<Geometry>::load(const std::string& path) {
+    unload();
+
+    std::ifstream file(path, std::ios::binary);
+    uint32_t header[6]{};
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+
+    if (header[0] != NNUE_MAGIC || header[1] != NNUE_VERSION || header[2] != Geometry::BOARD_HEIGHT ||
+        header[3] != Geometry::BOARD_WIDTH || header[4] != Geometry::WIN_AMT || header[5] != NNUE_HIDDEN) {
+        return false;
+    }
+
+    bool complete = read_values(file, feature_biases, NNUE_HIDDEN) &&
+                    read_values(file, feature_weights, FEATURES * NNUE_HIDDEN) &&
+                    file.read(reinterpret_cast<char*>(&value_bias), sizeof(value_bias)) &&
+                    read_values(file, value_weights, HEAD_INPUTS) &&
+                    read_values(file, policy_biases, SQUARES) &&
+                    read_values(file, policy_weights, SQUARES * HEAD_INPUTS);
+
+    // A longer file belongs to another network
+    if (!complete || file.peek() != std::ifstream::traits_type::eof()) {
+        unload();
+        return false;
+    }
+
+    loaded = true;
+    return true;
+}
+
+template <typename Geometry>
+void Network<Geometry>::unload() {
+    loaded = false;
+    feature_biases.clear();
+    feature_weights.clear();
+    value_bias = 0;
+    value_weights.clear();
+    policy_biases.clear();
+    policy_weights.clear();
+}
+
+template <typename Geometry>
+void Network<Geometry>::reset(Accumulator& accumulator) {
+    for (auto& values : accumulator.values) std::copy(feature_biases.begin(), feature_biases.end(), values);
+}
+
+template <typename Geometry>
+void Network<Geometry>::add_stone(Accumulator& accumulator, int color, Move move) {
+    for (int perspective = 0; perspective < 2; perspective++) {
+        nnue_kernels.add_column(accumulator.values[perspective],
+                                &feature_weights[get_feature(perspective, color, move) * NNUE_HIDDEN]);
+    }
+}
+
+template <typename Geometry>
+void Network<Geometry>::remove_stone(Accumulator& accumulator, int color, Move move) {
+    for (int perspective = 0; perspective < 2; perspective++) {
+        nnue_kernels.subtract_column(accumulator.values[perspective],
+                                     &feature_weights[get_feature(perspective, color, move) * NNUE_HIDDEN]);
+    }
+}
+
+template <typename Geometry>
+void Network<Geometry>::get_activations(const Accumulator& accumulator, int side, uint8_t* activations) {
+    nnue_kernels.clip(accumulator.values[side], activations);
+    nnue_kernels.clip(accumulator.values[side ^ 1], activations + NNUE_HIDDEN);
+}
+
+template <typename Geometry>
+int Network<Geometry>::get_value(const uint8_t* activations) {
+    int32_t output = value_bias + nnue_kernels.dot(activations, value_weights.data());
+    double logit = static_cast<double>(output) / (NNUE_ACTIVATION_SCALE * NNUE_WEIGHT_SCALE);
+
+    double win_probability = 1.0 / (1.0 + std::exp(-logit));
+    return static_cast<int>(std::lround((2.0 * win_probability - 1.0) * RESULT_UNITS));
+}
+
+template <typename Geometry>
+double Network<Geometry>::get_policy_logit(const uint8_t* activations, Move move) {
+    int square = move.row * Geometry::BOARD_WIDTH + move.col;
+    int32_t output = policy_biases[square] + nnue_kernels.dot(activations, &policy_weights[square * HEAD_INPUTS]);
+    return static_cast<double>(output) / (NNUE_ACTIVATION_SCALE * NNUE_WEIGHT_SCALE);
+}
+
+// One instance for every geometry in constants.h
+template class Network<TicTacToe>;
+template class Network<ConnectFour>;
+template class Network<Gomoku>;
+template class Network<Gomoku19>;
@@ -0,0 +1,86 @@
+#ifndef MCTS_MNK_NNUE_H
+#define MCTS_MNK_NNUE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "constants.h"
+
+constexpr int NNUE_HIDDEN = 256;
+
+// Fixed point scales of the quantized network: an activation of 1.0 and a head weight of 1.0
+constexpr int NNUE_ACTIVATION_SCALE = 127;
+constexpr int NNUE_WEIGHT_SCALE = 64;
+
+constexpr uint32_t NNUE_MAGIC = 0x4E4B4E4D;  // "MNKN"
+constexpr uint32_t NNUE_VERSION = 1;
+
+/*
+ * The first layer of a position seen by each colour. values[color] is the sum of the feature biases and of the
+ * weight columns of every stone's feature for that colour, so a stone adds or removes one column on each side.
+ */
+struct alignas(32) Accumulator {
+    int16_t values[2][NNUE_HIDDEN]{};
+};
+
+/*
+ * A small value and policy network in the style of NNUE. The features of a colour are the squares of its own stones
+ * and the squares of the other colour's stones. The accumulators of the side to move and of the opponent, clipped to
+ * [0, NNUE_ACTIVATION_SCALE], feed two linear heads: a value logit for the side to move and a policy logit for every
+ * square. Position keeps its accumulator up to date while a network is loaded, so an evaluation is only the heads.
+ *
+ * The weight file is little endian:
+ *     uint32 magic, version, height, width, win_amt, hidden
+ *     int16  feature_biases[hidden]
+ *     int16  feature_weights[2 * height * width][hidden]     own stones first, then the other colour's
+ *     int32  value_bias
+ *     int8   value_weights[2 * hidden]                       the side to move first, then the opponent
+ *     int32  policy_biases[height * width]
+ *     int8   policy_weights[height * width][2 * hidden]
+ * The logit of a head is its output divided by NNUE_ACTIVATION_SCALE * NNUE_WEIGHT_SCALE.
+ */
+template <typename Geometry>
+class Network {
+public:
+    static constexpr int SQUARES = Geometry::MAX_MOVES;
+    static constexpr int FEATURES = 2 * SQUARES;
+    static constexpr int HEAD_INPUTS = 2 * NNUE_HIDDEN;
+
+    bool loaded = false;
+
+    std::vector<int16_t> feature_biases{};
+    std::vector<int16_t> feature_weights{};
+    int32_t value_bias = 0;
+    std::vector<int8_t> value_weights{};
+    std::vector<int32_t> policy_biases{};
+    std::vector<int8_t> policy_weights{};
+
+    bool load(const std::string& path);
+    void unload();
+
+    // The feature of a stone of stone_color on the square as seen by perspective
+    static inline int get_feature(int perspective, int stone_color, Move move) {
+        return (stone_color == perspective ? 0 : SQUARES) + move.row * Geometry::BOARD_WIDTH + move.col;
+    }
+
+    void reset(Accumulator& accumulator);
+    void add_stone(Accumulator& accumulator, int color, Move move);
+    void remove_stone(Accumulator& accumulator, int color, Move move);
+
+    // The input of both heads, the clipped accumulator of the side to move followed by the opponent's
+    void get_activations(const Accumulator& accumulator, int side, uint8_t* activations);
+
+    // The value of the position for the side to move in RESULT_UNITS
+    int get_value(const uint8_t* activations);
+    double get_policy_logit(const uint8_t* activations, Move move);
+};
+
+// The network of every geometry, loaded at startup or by the protocol and read only during searches
+template <typename Geometry>
+inline Network<Geometry> NETWORK{};
+
+// The name of the kernels the network uses on this CPU
+const char* get_nnue_kernel_name();
+
+
+#endif //MCTS_MNK_NNUE_H
@@ -0,0 +1,145 @@
+#ifndef MCTS_MNK_PATTERNS_H
+#define MCTS_MNK_PATTERNS_H
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstdint>
+
+/*
+ * What a stone on an empty square makes along one line, from the weakest to the strongest. A four has one square
+ * left that makes a five through the stone and an open four has two or more, a three is one move away from a four
+ * and an open three one move away from an open four.
+ */
+constexpr uint8_t PATTERN_DEAD       = 0;  // No five can pass through the square along the line
+constexpr uint8_t PATTERN_ONE        = 1;
+constexpr uint8_t PATTERN_TWO        = 2;
+constexpr uint8_t PATTERN_THREE      = 3;
+constexpr uint8_t PATTERN_OPEN_THREE = 4;
+constexpr uint8_t PATTERN_FOUR       = 5;
+constexpr uint8_t PATTERN_OPEN_FOUR  = 6;
+constexpr uint8_t PATTERN_FIVE       = 7;
+
+constexpr int PATTERN_CLASSES = 8;
+
+// The cells of a line window seen by one colour
+constexpr int CELL_EMPTY   = 0;
+constexpr int CELL_OWN     = 1;
+constexpr int CELL_BLOCKED = 2;  // A stone of the other colour or the edge of the board
+
+constexpr int power_of_3(int exponent) {
+    return exponent == 0 ? 1 : 3 * power_of_3(exponent - 1);
+}
+
+/*
+ * The pattern class of every line window, the WIN_AMT - 1 cells on both sides of an empty square along a line.
+ * A window is encoded in base 3 with cell i worth power_of_3(i) times its CELL_ value, so a stone entering or
+ * leaving a window changes its code by one addition. The table is built once at startup for every win length.
+ */
+template <int win_amt>
+struct LinePatterns {
+    static constexpr int CELLS = 2 * win_amt - 1;
+    static constexpr int CENTER = win_amt - 1;
+    static constexpr int CODES = power_of_3(CELLS);
+
+    static_assert(CODES <= UINT16_MAX + 1, "line codes are stored in 16 bits");
+
+    // What one unit of a cell's value adds to the code
+    static constexpr std::array<int, CELLS> CELL_WEIGHTS = [] {
+        std::array<int, CELLS> weights{};
+        for (int i = 0; i < CELLS; i++) weights[i] = power_of_3(i);
+        return weights;
+    }();
+
+    std::array<uint8_t, CODES> classes{};
+
+    // How close the colour's stones in the window are, win_amt - distance for each of them
+    std::array<uint8_t, CODES> proximities{};
+
+    LinePatterns() {
+        for (int code = 0; code < CODES; code++) {
+            std::array<int, CELLS> cells{};
+            for (int i = 0, remaining = code; i < CELLS; i++, remaining /= 3) cells[i] = remaining % 3;
+
+            // Windows with a stone in the middle belong to occupied squares and are never looked up
+            if (cells[CENTER] != CELL_EMPTY) continue;
+
+            classes[code] = classify(cells);
+            for (int i = 0; i < CELLS; i++) {
+                if (cells[i] == CELL_OWN) proximities[code] += win_amt - std::abs(i - CENTER);
+            }
+        }
+    }
+
+    // Whether the cells hold win_amt stones in a row through both cells
+    static bool is_five(const std::array<int, CELLS>& cells, int first, int second) {
+        int low = std::min(first, second);
+        int high = std::max(first, second);
+
+        for (int start = std::max(0, high - win_amt + 1); start <= std::min(low, CELLS - win_amt); start++) {
+            bool five = true;
+            for (int i = start; i < start + win_amt; i++) five &= cells[i] == CELL_OWN;
+            if (five) return true;
+        }
+
+        return false;
+    }
+
+    // The empty cells that make a five through the center
+    static int count_wins(std::array<int, CELLS>& cells) {
+        int wins = 0;
+
+        for (int i = 0; i < CELLS; i++) {
+            if (cells[i] != CELL_EMPTY) continue;
+
+            cells[i] = CELL_OWN;
+            wins += is_five(cells, CENTER, i);
+            cells[i] = CELL_EMPTY;
+        }
+
+        return wins;
+    }
+
+    static uint8_t classify(std::array<int, CELLS> cells) {
+        cells[CENTER] = CELL_OWN;
+        if (is_five(cells, CENTER, CENTER)) return PATTERN_FIVE;
+
+        int wins = count_wins(cells);
+        if (wins >= 2) return PATTERN_OPEN_FOUR;
+        if (wins == 1) return PATTERN_FOUR;
+
+        // A five through the center now needs two more stones, the first of them decides between the threes
+        uint8_t best = PATTERN_DEAD;
+        for (int i = 0; i < CELLS; i++) {
+            if (cells[i] != CELL_EMPTY) continue;
+
+            cells[i] = CELL_OWN;
+            int next_wins = count_wins(cells);
+            cells[i] = CELL_EMPTY;
+
+            if (next_wins >= 2) return PATTERN_OPEN_THREE;
+            if (next_wins == 1) best = PATTERN_THREE;
+        }
+
+        if (best != PATTERN_DEAD) return best;
+
+        // Otherwise the stones in the fullest window a five could still fill
+        int most_stones = 0;
+        for (int start = 0; start <= CENTER; start++) {
+            int stones = 0;
+            for (int i = start; i < start + win_amt && stones >= 0; i++) {
+                stones = cells[i] == CELL_BLOCKED ? -1 : stones + (cells[i] == CELL_OWN);
+            }
+
+            most_stones = std::max(most_stones, stones);
+        }
+
+        return most_stones == 0 ? PATTERN_DEAD : most_stones == 1 ? PATTERN_ONE : PATTERN_TWO;
+    }
+};
+
+template <int win_amt>
+inline const LinePatterns<win_amt> LINE_PATTERNS{};
+
+
+#endif //MCTS_MNK_PATTERNS_H
@@ -5,17 +5,24 @@
 #include <iostream>
 #include "perft.h"
 
-uint64_t PerftEngine::perft(Position& position, PLY_TYPE depth) {
+template <typename Geometry>
+uint64_t PerftEngine<Geometry>::perft(Position<Geometry>& position, PLY_TYPE depth) {
     uint64_t nodes = 0;
 
     position.get_moves(moves);
     if (depth == 1) return moves.size();
 
     for (Move move : moves) {
-        position.make_move<NO_MOVE_ADJACENCY>(move);
+        position.template make_move<NO_MOVE_ADJACENCY>(move);
         nodes += perft(position, depth - 1);
-        position.undo_move<NO_MOVE_ADJACENCY>(move);
+        position.template undo_move<NO_MOVE_ADJACENCY>(move);
     }
 
     return nodes;
-}
\ No newline at end of file
+}
+
+// One instance for every geometry in constants.h
+template class PerftEngine<TicTacToe>;
+template class PerftEngine<ConnectFour>;
+template class PerftEngine<Gomoku>;
+template class PerftEngine<Gomoku19>;
@@ -8,10 +8,11 @@
 #include "constants.h"
 #include "position.h"
 
+template <typename Geometry>
 class PerftEngine {
-    FixedVector<Move, MAX_MOVES> moves;
+    FixedVector<Move, Geometry::MAX_MOVES> moves;
 public:
-    uint64_t perft(Position& position, PLY_TYPE depth);
+    uint64_t perft(Position<Geometry>& position, PLY_TYPE depth);
 };
 
 
@@ -3,14 +3,13 @@
 //
 
 #include <iostream>
+#include <cstdlib>
+#include <bit>
 #include "position.h"
 
 
-bool Position::is_empty(uint16_t row, uint16_t col) {
-    return board[row][col] == EMPTY || board[row][col] == ADJACENT;
-}
-
-void Position::get_moves(FixedVector<Move, MAX_MOVES>& moves) {
+template <typename Geometry>
+void Position<Geometry>::get_moves(FixedVector<Move, MAX_MOVES>& moves) {
     moves.clear();
     for (uint16_t row = 0; row < BOARD_HEIGHT; row++) {
         for (uint16_t col = 0; col < BOARD_WIDTH; col++) {
@@ -21,18 +20,8 @@ void Position::get_moves(FixedVector<Move, MAX_MOVES>& moves) {
     }
 }
 
-void Position::get_direct_adjacent_moves(FixedVector<Move, MAX_MOVES>& moves) {
-    moves.clear();
-    for (uint16_t row = 0; row < BOARD_HEIGHT; row++) {
-        for (uint16_t col = 0; col < BOARD_WIDTH; col++) {
-            if (board[row][col] == ADJACENT) {
-                moves.push_back(Move{row=row, col=col});
-            }
-        }
-    }
-}
-
-std::vector<Move> Position::get_adjacent_moves(int adjacency_range) {
+template <typename Geometry>
+std::vector<Move> Position<Geometry>::get_adjacent_moves(int adjacency_range) {
     std::vector<Move> moves;
 
     for (uint16_t row = 0; row < BOARD_HEIGHT; row++) {
@@ -63,98 +52,232 @@ std::vector<Move> Position::get_adjacent_moves(int adjacency_range) {
     return moves;
 }
 
-void Position::ray_threats(Threats& threats, int color, uint16_t row, uint16_t col, Increment increment) {
-    Increment opposite_increment = get_opposite_increment(increment);
-    std::unordered_set<Move>& threats_1 = color == side ? threats.our_threats_1 : threats.opp_threats_1;
-    std::unordered_set<Move>& threats_2 = color == side ? threats.our_threats_2 : threats.opp_threats_2;
+// Every square within WIN_AMT - 1 of the move along a line has the move in its window for that line
+template <typename Geometry>
+void Position<Geometry>::update_line_codes(Move move, int color, int sign) {
+    for (int direction = 0; direction < 4; direction++) {
+        Increment increment = UNIQUE_INCREMENTS[direction];
+
+        for (int distance = -(WIN_AMT - 1); distance <= WIN_AMT - 1; distance++) {
+            if (distance == 0) continue;
 
-    int count = 0;
-    int opposite_count = 0;
-    bool empty_end = false;
-    bool opposite_empty_end = false;
+            int new_row = move.row + distance * increment.row;
+            int new_col = move.col + distance * increment.col;
+            if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) continue;
 
+            // The move is the cell at -distance from the square's centre
+            int cell_weight = LinePatterns<WIN_AMT>::CELL_WEIGHTS[WIN_AMT - 1 - distance];
+            line_codes[color][direction][new_row][new_col] += sign * CELL_OWN * cell_weight;
+            line_codes[!color][direction][new_row][new_col] += sign * CELL_BLOCKED * cell_weight;
+        }
+    }
+}
 
-    // FORWARD RAY
-    int new_row = row;
-    int new_col = col;
-    for (int i = 0; i < WIN_AMT - 1; i++) {
-        new_row += increment.row;
-        new_col += increment.col;
+// A five in any direction is a threats_1 direction, an open four or a four in two directions are threats_2 ones
+template <typename Geometry>
+uint8_t Position<Geometry>::get_threat_directions(int color, uint16_t row, uint16_t col) {
+    uint8_t directions = 0;
+    uint8_t four_directions = 0;
 
-        if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) break;
+    for (int direction = 0; direction < 4; direction++) {
+        uint8_t pattern = get_pattern(color, direction, row, col);
 
-        if (board[new_row][new_col] == !color) break;
-        if (is_empty(new_row, new_col)) { empty_end = true; break; }
-        count++;
+        if (pattern == PATTERN_FIVE) directions |= 1 << direction;
+        else if (pattern == PATTERN_OPEN_FOUR) directions |= 1 << (direction + 4);
+        else if (pattern == PATTERN_FOUR) four_directions |= 1 << (direction + 4);
     }
 
-    // OPPOSITE RAY
-    new_row = row;
-    new_col = col;
-    for (int i = 0; i < WIN_AMT - 1; i++) {
-        new_row += opposite_increment.row;
-        new_col += opposite_increment.col;
+    if (std::popcount(four_directions) >= 2) directions |= four_directions;
+    return directions;
+}
+
+template <typename Geometry>
+void Position<Geometry>::set_threat_directions(int color, uint16_t row, uint16_t col, uint8_t directions) {
+    uint8_t& current_directions = threat_directions[color][row][col];
+    if (current_directions == directions) return;
+
+    threat_deltas.push_back(ThreatDelta{Move{row, col}, static_cast<uint8_t>(color), current_directions});
+    current_directions = directions;
+
+    if (directions & THREAT_1_MASK) threats.threats_1[color].insert(Move{row, col});
+    else threats.threats_1[color].erase(Move{row, col});
 
-        if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) break;
+    if (directions & THREAT_2_MASK) threats.threats_2[color].insert(Move{row, col});
+    else threats.threats_2[color].erase(Move{row, col});
+}
+
+template <typename Geometry>
+void Position<Geometry>::update_threats(Move move) {
+    threat_delta_starts.push_back(threat_deltas.size());
+
+    // An occupied square can't be a threat
+    set_threat_directions(WHITE, move.row, move.col, 0);
+    set_threat_directions(BLACK, move.row, move.col, 0);
+
+    // Only the squares on the lines through the move can see it
+    for (int direction = 0; direction < 4; direction++) {
+        Increment increment = UNIQUE_INCREMENTS[direction];
+
+        for (int distance = -(WIN_AMT - 1); distance <= WIN_AMT - 1; distance++) {
+            if (distance == 0) continue;
 
-        if (board[new_row][new_col] == !color) break;
-        if (is_empty(new_row, new_col)) { opposite_empty_end = true; break; }
-        opposite_count++;
+            int new_row = move.row + distance * increment.row;
+            int new_col = move.col + distance * increment.col;
+            if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) continue;
+            if (!is_empty(new_row, new_col)) continue;
+
+            for (int color : {WHITE, BLACK}) {
+                set_threat_directions(color, new_row, new_col, get_threat_directions(color, new_row, new_col));
+            }
+        }
     }
+}
+
+template <typename Geometry>
+void Position<Geometry>::undo_threats() {
+    uint32_t start = threat_delta_starts.pop();
 
-    if (count + opposite_count >= WIN_AMT - 1) threats_1.insert(Move{row, col});
-    else if (count + opposite_count == WIN_AMT - 2 && empty_end && opposite_empty_end) threats_2.insert(Move{row, col});
+    while (threat_deltas.size() > start) {
+        ThreatDelta delta = threat_deltas.pop();
+        Move square = delta.square;
+
+        threat_directions[delta.color][square.row][square.col] = delta.directions;
+
+        if (delta.directions & THREAT_1_MASK) threats.threats_1[delta.color].insert(square);
+        else threats.threats_1[delta.color].erase(square);
+
+        if (delta.directions & THREAT_2_MASK) threats.threats_2[delta.color].insert(square);
+        else threats.threats_2[delta.color].erase(square);
+    }
 }
 
-void Position::get_square_threats(Threats& threats, uint16_t row, uint16_t col) {
-    for (Increment increment : UNIQUE_INCREMENTS) {
-        ray_threats(threats, WHITE, row, col, increment);
-        ray_threats(threats, BLACK, row, col, increment);
+template <typename Geometry>
+int Position<Geometry>::update_runs(Move move) {
+    int color = board[move.row][move.col];
+    int longest_run = 0;
+    RunUndo run_undo{};
+
+    for (int direction = 0; direction < 4; direction++) {
+        Increment increment = UNIQUE_INCREMENTS[direction];
+
+        int forward_row = move.row + increment.row;
+        int forward_col = move.col + increment.col;
+        int backward_row = move.row - increment.row;
+        int backward_col = move.col - increment.col;
+
+        int forward = 0;
+        int backward = 0;
+
+        if (forward_row >= 0 && forward_row < BOARD_HEIGHT && forward_col >= 0 && forward_col < BOARD_WIDTH &&
+            board[forward_row][forward_col] == color) {
+            forward = run_lengths[direction][forward_row][forward_col];
+        }
+
+        if (backward_row >= 0 && backward_row < BOARD_HEIGHT && backward_col >= 0 && backward_col < BOARD_WIDTH &&
+            board[backward_row][backward_col] == color) {
+            backward = run_lengths[direction][backward_row][backward_col];
+        }
+
+        // Join the two runs, only their new ends need the new length
+        int length = forward + backward + 1;
+        run_lengths[direction][move.row + forward * increment.row][move.col + forward * increment.col] = length;
+        run_lengths[direction][move.row - backward * increment.row][move.col - backward * increment.col] = length;
+
+        run_undo.forward[direction] = forward;
+        run_undo.backward[direction] = backward;
+        longest_run = std::max(longest_run, length);
     }
+
+    run_undos.push_back(run_undo);
+    return longest_run;
 }
 
-void Position::get_threats(Threats& threats) {
-    for (uint16_t row = 0; row < BOARD_HEIGHT; row++) {
-        for (uint16_t col = 0; col < BOARD_WIDTH; col++) {
-            if (board[row][col] == ADJACENT) {
-                get_square_threats(threats, row, col);
-            }
+template <typename Geometry>
+void Position<Geometry>::undo_runs(Move move) {
+    RunUndo run_undo = run_undos.pop();
+
+    // Split the run back into the two runs on either side of the move
+    for (int direction = 0; direction < 4; direction++) {
+        Increment increment = UNIQUE_INCREMENTS[direction];
+        int forward = run_undo.forward[direction];
+        int backward = run_undo.backward[direction];
+
+        if (forward) {
+            run_lengths[direction][move.row + increment.row][move.col + increment.col] = forward;
+            run_lengths[direction][move.row + forward * increment.row][move.col + forward * increment.col] = forward;
+        }
+
+        if (backward) {
+            run_lengths[direction][move.row - increment.row][move.col - increment.col] = backward;
+            run_lengths[direction][move.row - backward * increment.row][move.col - backward * increment.col] = backward;
         }
     }
 }
 
-int Position::get_result(Move last_move) {
+template <typename Geometry>
+int Position<Geometry>::get_result(Move last_move) {
     if (last_move.row == BOARD_HEIGHT) {
         return NO_SCORE;
     }
 
     int color = board[last_move.row][last_move.col];
-    for (int test_y = last_move.row - (WIN_AMT - 1) / 2; test_y < last_move.row + (WIN_AMT + 1) / 2; test_y++) {
-        for (int test_x = last_move.col - (WIN_AMT - 1) / 2; test_x < last_move.col + (WIN_AMT + 1) / 2; test_x++) {
-            if (test_y < 0 || test_y >= BOARD_HEIGHT || test_x < 0 || test_x >= BOARD_WIDTH) continue;
-            if (board[test_y][test_x] != color) continue;
-
-            for (Increment increment : TRAVERSAL_INCREMENTS) {
-                int new_y = test_y;
-                int new_x = test_x;
-                for (int i = 1; i < WIN_AMT; i++) {
-                    new_y += increment.row;
-                    new_x += increment.col;
-
-                    if (new_y < 0 || new_y >= BOARD_HEIGHT || new_x < 0 || new_x >= BOARD_WIDTH) break;
-                    if (board[new_y][new_x] != color) break;
-
-                    if (i + 1 == WIN_AMT) return color;
-                }
+    if (color != WHITE && color != BLACK) return NO_SCORE;
+
+    for (Increment increment : UNIQUE_INCREMENTS) {
+        if (pieces[color].has_line(increment)) return color;
+    }
+
+    return NO_SCORE;
+}
+
+// Rebuilds the accumulator from the stones on the board, for positions set up before the network was loaded
+template <typename Geometry>
+void Position<Geometry>::refresh_accumulator() {
+    if (!NETWORK<Geometry>.loaded) return;
+
+    NETWORK<Geometry>.reset(accumulator);
+    for (uint16_t row = 0; row < BOARD_HEIGHT; row++) {
+        for (uint16_t col = 0; col < BOARD_WIDTH; col++) {
+            if (board[row][col] == WHITE || board[row][col] == BLACK) {
+                NETWORK<Geometry>.add_stone(accumulator, board[row][col], Move{row, col});
             }
         }
     }
+}
 
-    return NO_SCORE;
+// The key of the position seen through the symmetry from scratch, make_move and undo_move keep symmetric_keys equal
+template <typename Geometry>
+uint64_t Position<Geometry>::compute_hash_key(int symmetry) {
+    uint64_t key = side == BLACK ? ZOBRIST_KEYS<Geometry>.side : 0;
+
+    for (int row = 0; row < BOARD_HEIGHT; row++) {
+        for (int col = 0; col < BOARD_WIDTH; col++) {
+            if (board[row][col] == WHITE || board[row][col] == BLACK) {
+                key ^= ZOBRIST_KEYS<Geometry>.pieces[board[row][col]][row][col][symmetry];
+            }
+        }
+    }
+
+    return key;
+}
+
+// Called after every make_move and undo_move in builds with DEBUG_HASH_KEY defined
+template <typename Geometry>
+void Position<Geometry>::check_hash_key() {
+    for (int symmetry = 0; symmetry < Geometry::SYMMETRIES; symmetry++) {
+        uint64_t key = compute_hash_key(symmetry);
+        if (key == symmetric_keys[symmetry]) continue;
+
+        std::cerr << "hash key mismatch in symmetry " << symmetry << ": incremental " << std::hex
+                  << symmetric_keys[symmetry] << ", computed " << key << std::dec << std::endl;
+        print_board();
+        std::abort();
+    }
 }
 
 
-void Position::print_board() {
+template <typename Geometry>
+void Position<Geometry>::print_board() {
     std::string string = "  ";
     int max_digits = static_cast<int>(std::max(std::to_string(BOARD_HEIGHT).length(), std::to_string(BOARD_WIDTH).length()));
 
@@ -191,7 +314,8 @@ void Position::print_board() {
 }
 
 
-void Position::visualize_moves(const std::vector<Move>& moves) {
+template <typename Geometry>
+void Position<Geometry>::visualize_moves(const std::vector<Move>& moves) {
 
     if (moves.empty()) return;
 
@@ -246,4 +370,10 @@ void Position::visualize_moves(const std::vector<Move>& moves) {
     }
 
     std::cout << string;
-}
\ No newline at end of file
+}
+
+// One instance for every geometry in constants.h
+template class Position<TicTacToe>;
+template class Position<ConnectFour>;
+template class Position<Gomoku>;
+template class Position<Gomoku19>;
@@ -7,15 +7,36 @@
 
 #include "constants.h"
 #include "fixed_vector.h"
+#include "bitboard.h"
+#include "move_set.h"
+#include "zobrist.h"
+#include "symmetry.h"
+#include "patterns.h"
+#include "nnue.h"
+#include <cassert>
 #include <vector>
-#include <unordered_set>
 
+// Bit layout of a square's threat directions: bits 0-3 for threats_1 and bits 4-7 for threats_2,
+// one bit per UNIQUE_INCREMENTS direction.
+constexpr uint8_t THREAT_1_MASK = 0x0F;
+constexpr uint8_t THREAT_2_MASK = 0xF0;
+
+template <typename Geometry>
 struct Threats {
-    std::unordered_set<Move> our_threats_1{};  // One move threats
-    std::unordered_set<Move> our_threats_2{};  // Threats to create a chain with threats on both sides
+    MoveSet<Geometry> threats_1[2]{};  // Moves that make a five, indexed by colour
+    MoveSet<Geometry> threats_2[2]{};  // Moves that make an open four or two fours, indexed by colour
+};
+
+struct ThreatDelta {
+    Move square{};
+    uint8_t color = WHITE;
+    uint8_t directions = 0;  // Threat directions of the square before the change
+};
 
-    std::unordered_set<Move> opp_threats_1{};  // One move threats
-    std::unordered_set<Move> opp_threats_2{};  // Threats to create a chain with threats on both sides
+// Lengths of the runs directly before and after a move in every UNIQUE_INCREMENTS direction, used to undo it
+struct RunUndo {
+    uint8_t backward[4]{};
+    uint8_t forward[4]{};
 };
 
 struct State {
@@ -23,26 +44,87 @@ struct State {
     Move move{};
 };
 
+template <typename Geometry>
 class Position {
 public:
+    static constexpr int BOARD_HEIGHT = Geometry::BOARD_HEIGHT;
+    static constexpr int BOARD_WIDTH = Geometry::BOARD_WIDTH;
+    static constexpr int WIN_AMT = Geometry::WIN_AMT;
+    static constexpr int MAX_MOVES = Geometry::MAX_MOVES;
 
-    bool is_empty(uint16_t row, uint16_t col);
+    // Every move can change the threats of its own square and of the squares within WIN_AMT - 1 along its four lines
+    static constexpr int MAX_THREAT_DELTAS = 2 * (4 * 2 * (WIN_AMT - 1) + 1);
 
     void get_moves(FixedVector<Move, MAX_MOVES>& moves);
-    void get_direct_adjacent_moves(FixedVector<Move, MAX_MOVES>& moves);
     std::vector<Move> get_adjacent_moves(int adjacency_range);
 
-    void ray_threats(Threats& threats, int color, uint16_t row, uint16_t col, Increment increment);
-    void get_square_threats(Threats& threats, uint16_t row, uint16_t col);
-    void get_threats(Threats& threats);
+    void update_line_codes(Move move, int color, int sign);
+    uint8_t get_threat_directions(int color, uint16_t row, uint16_t col);
+    void set_threat_directions(int color, uint16_t row, uint16_t col, uint8_t directions);
+    void update_threats(Move move);
+    void undo_threats();
+
+    int update_runs(Move move);
+    void undo_runs(Move move);
 
     int get_result(Move last_move);
+    void refresh_accumulator();
+    uint64_t compute_hash_key(int symmetry);
+    void check_hash_key();
     void print_board();
     void visualize_moves(const std::vector<Move>& moves);
 
     int side = 0;
 
+    /*
+     * Zobrist keys of the position seen through every symmetry of the board, kept up to date by make_move and
+     * undo_move. symmetric_keys[IDENTITY] is the key of the position itself, the smallest key is its canonical key,
+     * which is the same for all positions that are rotations or reflections of each other.
+     */
+    uint64_t symmetric_keys[Geometry::SYMMETRIES]{};
+
     int board[BOARD_HEIGHT][BOARD_WIDTH]{};
+    Bitboard<Geometry> pieces[2]{};
+
+    /*
+     * Threats are maintained incrementally by make_move and undo_move. Every change of a square's
+     * threat directions is pushed onto threat_deltas so that undo_move only has to restore them.
+     */
+    Threats<Geometry> threats{};
+    uint8_t threat_directions[2][BOARD_HEIGHT][BOARD_WIDTH]{};
+    FixedVector<ThreatDelta, MAX_MOVES * MAX_THREAT_DELTAS> threat_deltas{};
+    FixedVector<uint32_t, MAX_MOVES + 1> threat_delta_starts{};
+
+    /*
+     * For every direction, the length of the run of same coloured stones a stone belongs to.
+     * Only the two end stones of a run are kept up to date, which is all that make_move needs since
+     * the neighbours of an empty square are always the ends of their runs.
+     */
+    uint8_t run_lengths[4][BOARD_HEIGHT][BOARD_WIDTH]{};
+    FixedVector<RunUndo, MAX_MOVES + 1> run_undos{};
+
+    /*
+     * The frontier holds every empty square with a stone directly next to it. It is only maintained by the
+     * MOVE_ADJACENCY versions of make_move and undo_move, so it is stale while a NO_MOVE_ADJACENCY move is on the
+     * board, which get_frontier asserts in debug builds. The stone count of each square's neighbourhood that it is
+     * built from is kept by both versions, so is_adjacent is always valid.
+     */
+    MoveSet<Geometry> frontier{};
+    uint8_t neighbour_counts[BOARD_HEIGHT][BOARD_WIDTH]{};
+    int stale_frontier_moves = 0;
+
+    /*
+     * The line window of every square in every UNIQUE_INCREMENTS direction as seen by each colour, encoded for
+     * LINE_PATTERNS. make_move and undo_move add and remove their stone from the windows that see it, squares past
+     * the edge of the board are blocked from the start.
+     */
+    uint16_t line_codes[2][4][BOARD_HEIGHT][BOARD_WIDTH]{};
+
+    /*
+     * The first layer of NETWORK, only kept up to date by make_move and undo_move while a network is loaded.
+     * refresh_accumulator rebuilds it from the board for positions that are older than the network.
+     */
+    Accumulator accumulator{};
 
     Position() {
         for (auto & i : board) {
@@ -50,61 +132,170 @@ public:
                 j = EMPTY;
             }
         }
+
+        for (int direction = 0; direction < 4; direction++) {
+            Increment increment = UNIQUE_INCREMENTS[direction];
+
+            for (int row = 0; row < BOARD_HEIGHT; row++) {
+                for (int col = 0; col < BOARD_WIDTH; col++) {
+                    int code = 0;
+                    for (int cell = 0; cell < 2 * WIN_AMT - 1; cell++) {
+                        int cell_row = row + (cell - WIN_AMT + 1) * increment.row;
+                        int cell_col = col + (cell - WIN_AMT + 1) * increment.col;
+                        if (cell_row < 0 || cell_row >= BOARD_HEIGHT || cell_col < 0 || cell_col >= BOARD_WIDTH) {
+                            code += CELL_BLOCKED * LinePatterns<WIN_AMT>::CELL_WEIGHTS[cell];
+                        }
+                    }
+
+                    line_codes[WHITE][direction][row][col] = static_cast<uint16_t>(code);
+                    line_codes[BLACK][direction][row][col] = static_cast<uint16_t>(code);
+                }
+            }
+        }
+
+        refresh_accumulator();
+    }
+
+    inline bool is_empty(uint16_t row, uint16_t col) {
+        int index = Bitboard<Geometry>::get_index(row, col);
+        return !pieces[WHITE].test(index) && !pieces[BLACK].test(index);
     }
 
     inline bool is_adjacent(uint16_t row, uint16_t col) {
-        for (Increment increment : TRAVERSAL_INCREMENTS) {
-            int new_row = row + increment.row;
-            int new_col = col + increment.col;
-            if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) continue;
+        return neighbour_counts[row][col] != 0;
+    }
+
+    inline MoveSet<Geometry>& get_frontier() {
+        assert(stale_frontier_moves == 0);
+        return frontier;
+    }
+
+    // What a stone of the colour on the empty square makes along the direction
+    inline uint8_t get_pattern(int color, int direction, uint16_t row, uint16_t col) {
+        return LINE_PATTERNS<WIN_AMT>.classes[line_codes[color][direction][row][col]];
+    }
+
+    inline uint8_t get_proximity(int color, int direction, uint16_t row, uint16_t col) {
+        return LINE_PATTERNS<WIN_AMT>.proximities[line_codes[color][direction][row][col]];
+    }
+
+    inline bool is_full() {
+        return (pieces[WHITE] | pieces[BLACK]).count() == MAX_MOVES;
+    }
 
-            if (!is_empty(new_row, new_col)) return true;
+    inline uint64_t get_hash_key() {
+        return symmetric_keys[IDENTITY];
+    }
+
+    // The symmetry that takes the position to its canonical orientation
+    inline int get_canonical_symmetry() {
+        int canonical_symmetry = IDENTITY;
+        for (int symmetry = 1; symmetry < Geometry::SYMMETRIES; symmetry++) {
+            if (symmetric_keys[symmetry] < symmetric_keys[canonical_symmetry]) canonical_symmetry = symmetry;
         }
 
-        return false;
+        return canonical_symmetry;
+    }
+
+    inline uint64_t get_canonical_key() {
+        return symmetric_keys[get_canonical_symmetry()];
+    }
+
+    // Maps a move of the position to the same move in the canonical orientation
+    inline Move get_canonical_move(Move move) {
+        return transform_move<Geometry>(move, get_canonical_symmetry());
+    }
+
+    // Maps a move in the canonical orientation, from a book or a cache, back onto the position
+    inline Move get_actual_move(Move canonical_move) {
+        return transform_move<Geometry>(canonical_move, INVERSE_SYMMETRIES[get_canonical_symmetry()]);
+    }
+
+    inline void update_hash_keys(int color, Move move) {
+        const uint64_t* square_keys = ZOBRIST_KEYS<Geometry>.pieces[color][move.row][move.col];
+        for (int symmetry = 0; symmetry < Geometry::SYMMETRIES; symmetry++) {
+            symmetric_keys[symmetry] ^= square_keys[symmetry] ^ ZOBRIST_KEYS<Geometry>.side;
+        }
     }
 
+    // Makes the move and returns the colour that won with it, or NO_SCORE
     template<bool adjacency>
-    inline void make_move(Move move) {
+    inline int make_move_get_result(Move move) {
+        int color = side;
+
         board[move.row][move.col] = side;
+        pieces[side].set(Bitboard<Geometry>::get_index(move.row, move.col));
+        update_hash_keys(side, move);
         side ^= 1;
 
-        if constexpr (adjacency) {
-            for (Increment increment : TRAVERSAL_INCREMENTS) {
-                int new_row = move.row + increment.row;
-                int new_col = move.col + increment.col;
-                if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) continue;
-                if (board[new_row][new_col] != EMPTY) continue;
+        update_line_codes(move, color, 1);
+        update_threats(move);
+        if (NETWORK<Geometry>.loaded) NETWORK<Geometry>.add_stone(accumulator, color, move);
+        int longest_run = update_runs(move);
+
+        if constexpr (adjacency) frontier.erase(move);
+        else stale_frontier_moves++;
 
-                board[new_row][new_col] = ADJACENT;
+        for (Increment increment : TRAVERSAL_INCREMENTS) {
+            int new_row = move.row + increment.row;
+            int new_col = move.col + increment.col;
+            if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) continue;
+
+            neighbour_counts[new_row][new_col]++;
+            if constexpr (adjacency) {
+                if (board[new_row][new_col] == EMPTY) {
+                    frontier.insert(Move{static_cast<uint16_t>(new_row), static_cast<uint16_t>(new_col)});
+                }
             }
         }
+
+#ifdef DEBUG_HASH_KEY
+        check_hash_key();
+#endif
+
+        return longest_run >= WIN_AMT ? color : NO_SCORE;
+    }
+
+    template<bool adjacency>
+    inline void make_move(Move move) {
+        make_move_get_result<adjacency>(move);
     }
 
     template<bool adjacency>
     inline void undo_move(Move move) {
         board[move.row][move.col] = EMPTY;
         side ^= 1;
+        pieces[side].clear(Bitboard<Geometry>::get_index(move.row, move.col));
+        update_hash_keys(side, move);
 
-        if constexpr (adjacency) {
+        undo_threats();
+        update_line_codes(move, side, -1);
+        undo_runs(move);
+        if (NETWORK<Geometry>.loaded) NETWORK<Geometry>.remove_stone(accumulator, side, move);
+
+        // Neighbours that were only adjacent to this stone leave the frontier, and the square itself rejoins it
+        for (Increment increment : TRAVERSAL_INCREMENTS) {
+            int new_row = move.row + increment.row;
+            int new_col = move.col + increment.col;
+            if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) continue;
 
-            /* Check if the current square should be adjacent or not and also
-             * check if all adjacent squares are still adjacent
-             */
-            for (Increment increment : TRAVERSAL_INCREMENTS) {
-                int new_row = move.row + increment.row;
-                int new_col = move.col + increment.col;
-                if (new_row < 0 || new_row >= BOARD_HEIGHT || new_col < 0 || new_col >= BOARD_WIDTH) continue;
-
-                if (is_empty(new_row, new_col)) {
-                    board[new_row][new_col] = is_adjacent(new_row, new_col) ? ADJACENT : EMPTY;
-                } else {
-                    board[move.row][move.col] = ADJACENT;
+            neighbour_counts[new_row][new_col]--;
+            if constexpr (adjacency) {
+                if (neighbour_counts[new_row][new_col] == 0) {
+                    frontier.erase(Move{static_cast<uint16_t>(new_row), static_cast<uint16_t>(new_col)});
                 }
             }
+        }
 
-            // print_board();
+        if constexpr (adjacency) {
+            if (is_adjacent(move.row, move.col)) frontier.insert(move);
+        } else {
+            stale_frontier_moves--;
         }
+
+#ifdef DEBUG_HASH_KEY
+        check_hash_key();
+#endif
     }
 };
 
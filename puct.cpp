@@ -0,0 +1,177 @@
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include "puct.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PUCT_X86
+#endif
+
+// Vector loads of statistics other threads are updating are invisible to ThreadSanitizer's atomics
+#if defined(__SANITIZE_THREAD__)
+#define PUCT_SCALAR_ONLY
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define PUCT_SCALAR_ONLY
+#endif
+#endif
+
+using PuctKernel = uint32_t (*)(int*, int*, uint16_t*, uint8_t*, uint32_t, float, float&);
+
+static inline float get_puct(int visits, int win_count, uint16_t prior, float exploration) {
+    auto float_visits = static_cast<float>(visits);
+    return static_cast<float>(win_count) / float_visits
+           + exploration * static_cast<float>(prior) / (1.0f + float_visits);
+}
+
+// Scores the siblings from start onwards one at a time, continuing from the best one found so far
+static inline uint32_t select_puct_tail(int* visits, int* win_counts, uint16_t* priors, uint8_t* proofs,
+                                        uint32_t start, uint32_t count, float exploration, uint32_t best_offset,
+                                        float& best_score) {
+    for (uint32_t i = start; i < count; i++) {
+        if (std::atomic_ref<uint8_t>(proofs[i]).load(std::memory_order_relaxed)) continue;
+
+        float score = get_puct(std::atomic_ref<int>(visits[i]).load(std::memory_order_relaxed),
+                               std::atomic_ref<int>(win_counts[i]).load(std::memory_order_relaxed),
+                               priors[i], exploration);
+
+        if (score > best_score) {
+            best_score = score;
+            best_offset = i;
+        }
+    }
+
+    return best_offset;
+}
+
+// Picks the best lane of a vector kernel, the lowest offset on ties
+static inline uint32_t reduce_lanes(const float* scores, const uint32_t* offsets, int lanes, float& best_score) {
+    uint32_t best_offset = 0;
+    best_score = -std::numeric_limits<float>::infinity();
+
+    for (int lane = 0; lane < lanes; lane++) {
+        if (scores[lane] > best_score || (scores[lane] == best_score && offsets[lane] < best_offset)) {
+            best_score = scores[lane];
+            best_offset = offsets[lane];
+        }
+    }
+
+    return best_offset;
+}
+
+static uint32_t select_puct_scalar(int* visits, int* win_counts, uint16_t* priors, uint8_t* proofs, uint32_t count,
+                                   float exploration, float& best_score) {
+    best_score = -std::numeric_limits<float>::infinity();
+    return select_puct_tail(visits, win_counts, priors, proofs, 0, count, exploration, 0, best_score);
+}
+
+#ifdef PUCT_X86
+
+__attribute__((target("sse4.1")))
+static uint32_t select_puct_sse(int* visits, int* win_counts, uint16_t* priors, uint8_t* proofs, uint32_t count,
+                                float exploration, float& best_score) {
+    __m128 minus_infinities = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    __m128 best_scores = minus_infinities;
+    __m128i best_offsets = _mm_setzero_si128();
+    __m128i offsets = _mm_setr_epi32(0, 1, 2, 3);
+
+    __m128 explorations = _mm_set1_ps(exploration);
+    __m128 ones = _mm_set1_ps(1.0f);
+
+    uint32_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 lane_visits = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<__m128i*>(visits + i)));
+        __m128 lane_win_counts = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<__m128i*>(win_counts + i)));
+        __m128 lane_priors = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i*>(priors + i))));
+
+        int lane_proofs;
+        std::memcpy(&lane_proofs, proofs + i, sizeof(lane_proofs));
+        __m128i proven = _mm_cmpgt_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(lane_proofs)), _mm_setzero_si128());
+
+        __m128 scores = _mm_add_ps(_mm_div_ps(lane_win_counts, lane_visits),
+                                   _mm_div_ps(_mm_mul_ps(explorations, lane_priors), _mm_add_ps(ones, lane_visits)));
+        scores = _mm_blendv_ps(scores, minus_infinities, _mm_castsi128_ps(proven));
+
+        __m128 better = _mm_cmpgt_ps(scores, best_scores);
+        best_scores = _mm_blendv_ps(best_scores, scores, better);
+        best_offsets = _mm_blendv_epi8(best_offsets, offsets, _mm_castps_si128(better));
+        offsets = _mm_add_epi32(offsets, _mm_set1_epi32(4));
+    }
+
+    alignas(16) float lane_scores[4];
+    alignas(16) uint32_t lane_offsets[4];
+    _mm_store_ps(lane_scores, best_scores);
+    _mm_store_si128(reinterpret_cast<__m128i*>(lane_offsets), best_offsets);
+
+    uint32_t best_offset = reduce_lanes(lane_scores, lane_offsets, 4, best_score);
+    return select_puct_tail(visits, win_counts, priors, proofs, i, count, exploration, best_offset, best_score);
+}
+
+__attribute__((target("avx2")))
+static uint32_t select_puct_avx2(int* visits, int* win_counts, uint16_t* priors, uint8_t* proofs, uint32_t count,
+                                 float exploration, float& best_score) {
+    __m256 minus_infinities = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 best_scores = minus_infinities;
+    __m256i best_offsets = _mm256_setzero_si256();
+    __m256i offsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    __m256 explorations = _mm256_set1_ps(exploration);
+    __m256 ones = _mm256_set1_ps(1.0f);
+
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 lane_visits = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<__m256i*>(visits + i)));
+        __m256 lane_win_counts = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<__m256i*>(win_counts + i)));
+        __m256 lane_priors = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<__m128i*>(priors + i))));
+
+        __m256i proven = _mm256_cmpgt_epi32(
+                _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i*>(proofs + i))), _mm256_setzero_si256());
+
+        __m256 scores = _mm256_add_ps(_mm256_div_ps(lane_win_counts, lane_visits),
+                                      _mm256_div_ps(_mm256_mul_ps(explorations, lane_priors),
+                                                    _mm256_add_ps(ones, lane_visits)));
+        scores = _mm256_blendv_ps(scores, minus_infinities, _mm256_castsi256_ps(proven));
+
+        __m256 better = _mm256_cmp_ps(scores, best_scores, _CMP_GT_OQ);
+        best_scores = _mm256_blendv_ps(best_scores, scores, better);
+        best_offsets = _mm256_blendv_epi8(best_offsets, offsets, _mm256_castps_si256(better));
+        offsets = _mm256_add_epi32(offsets, _mm256_set1_epi32(8));
+    }
+
+    alignas(32) float lane_scores[8];
+    alignas(32) uint32_t lane_offsets[8];
+    _mm256_store_ps(lane_scores, best_scores);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lane_offsets), best_offsets);
+
+    uint32_t best_offset = reduce_lanes(lane_scores, lane_offsets, 8, best_score);
+    return select_puct_tail(visits, win_counts, priors, proofs, i, count, exploration, best_offset, best_score);
+}
+
+#endif
+
+struct PuctKernelChoice {
+    PuctKernel kernel;
+    const char* name;
+};
+
+static PuctKernelChoice choose_puct_kernel() {
+#if defined(PUCT_X86) && !defined(PUCT_SCALAR_ONLY)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return {select_puct_avx2, "avx2"};
+    if (__builtin_cpu_supports("sse4.1")) return {select_puct_sse, "sse4.1"};
+#endif
+
+    return {select_puct_scalar, "scalar"};
+}
+
+static const PuctKernelChoice puct_kernel = choose_puct_kernel();
+
+uint32_t select_puct(int* visits, int* win_counts, uint16_t* priors, uint8_t* proofs, uint32_t count,
+                     float exploration, float& best_score) {
+    return puct_kernel.kernel(visits, win_counts, priors, proofs, count, exploration, best_score);
+}
+
+const char* get_puct_kernel_name() {
+    return puct_kernel.name;
+}
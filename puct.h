@@ -0,0 +1,20 @@
+#ifndef MCTS_MNK_PUCT_H
+#define MCTS_MNK_PUCT_H
+
+#include <cstdint>
+
+/*
+ * Returns the offset of the sibling with the highest PUCT score
+ *     win_counts[i] / visits[i] + exploration * priors[i] / (1 + visits[i])
+ * in float precision, the first one on ties. Siblings with a non-zero proofs[i] are skipped. The best score is
+ * written to best_score, which is -infinity if every sibling was skipped or count is 0.
+ * The AVX2 or SSE4.1 kernel is chosen at runtime when the CPU supports it, with a scalar kernel as the fallback.
+ */
+uint32_t select_puct(int* visits, int* win_counts, uint16_t* priors, uint8_t* proofs, uint32_t count,
+                     float exploration, float& best_score);
+
+// The name of the kernel select_puct uses on this CPU
+const char* get_puct_kernel_name();
+
+
+#endif //MCTS_MNK_PUCT_H
@@ -0,0 +1,74 @@
+#ifndef MCTS_MNK_RANDOM_H
+#define MCTS_MNK_RANDOM_H
+
+#include <cstdint>
+
+/*
+ * xoshiro256** seeded through splitmix64. Every search thread owns one, so rollouts never share
+ * generator state, and a fixed seed replays the same random choices.
+ */
+class Random {
+
+private:
+    uint64_t state[4]{};
+
+    static inline uint64_t rotate_left(uint64_t value, int shift) {
+        return (value << shift) | (value >> (64 - shift));
+    }
+
+public:
+    // Also used at compile time to fill the Zobrist tables
+    static constexpr uint64_t splitmix64(uint64_t& seed) {
+        uint64_t value = (seed += 0x9E3779B97F4A7C15ULL);
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    Random() { seed(0); }
+    explicit Random(uint64_t seed_value) { seed(seed_value); }
+
+    void seed(uint64_t seed_value) {
+        for (uint64_t& word : state) word = splitmix64(seed_value);
+    }
+
+    inline uint64_t next() {
+        uint64_t result = rotate_left(state[1] * 5, 7) * 9;
+        uint64_t shifted = state[1] << 17;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= shifted;
+        state[3] = rotate_left(state[3], 45);
+
+        return result;
+    }
+
+    // A uniform number in [0, range) without modulo bias, by Lemire's multiply and reject method
+    inline uint32_t bounded(uint32_t range) {
+        uint64_t product = (next() >> 32) * range;
+        auto low = static_cast<uint32_t>(product);
+
+        if (low < range) {
+            uint32_t threshold = -range % range;
+            while (low < threshold) {
+                product = (next() >> 32) * range;
+                low = static_cast<uint32_t>(product);
+            }
+        }
+
+        return static_cast<uint32_t>(product >> 32);
+    }
+};
+
+// Derives independent seeds for several generators from one seed
+inline uint64_t get_stream_seed(uint64_t seed, uint64_t stream) {
+    uint64_t value = seed ^ (stream * 0xD1B54A32D192ED03ULL);
+    value = (value ^ (value >> 32)) * 0xD6E8FEB86659FD93ULL;
+    return value ^ (value >> 32);
+}
+
+
+#endif //MCTS_MNK_RANDOM_H
@@ -0,0 +1,78 @@
+#ifndef MCTS_MNK_SYMMETRY_H
+#define MCTS_MNK_SYMMETRY_H
+
+#include <array>
+#include "constants.h"
+
+/*
+ * The symmetries of the board. The first four keep the board's shape and exist on every board, the last four swap
+ * rows and columns and only exist on square boards, see Geometry::SYMMETRIES.
+ */
+constexpr int IDENTITY       = 0;
+constexpr int FLIP_ROWS      = 1;
+constexpr int FLIP_COLS      = 2;
+constexpr int ROTATE_180     = 3;
+constexpr int TRANSPOSE      = 4;
+constexpr int ROTATE_90      = 5;  // Clockwise
+constexpr int ROTATE_270     = 6;
+constexpr int ANTI_TRANSPOSE = 7;
+
+constexpr int MAX_SYMMETRIES = 8;
+
+constexpr int INVERSE_SYMMETRIES[MAX_SYMMETRIES] = {
+        IDENTITY, FLIP_ROWS, FLIP_COLS, ROTATE_180, TRANSPOSE, ROTATE_270, ROTATE_90, ANTI_TRANSPOSE
+};
+
+constexpr Move transform_move(Move move, int symmetry, int height, int width) {
+    auto row = static_cast<uint16_t>(height - 1 - move.row);
+    auto col = static_cast<uint16_t>(width - 1 - move.col);
+
+    switch (symmetry) {
+        case FLIP_ROWS:      return Move{row, move.col};
+        case FLIP_COLS:      return Move{move.row, col};
+        case ROTATE_180:     return Move{row, col};
+        case TRANSPOSE:      return Move{move.col, move.row};
+        case ROTATE_90:      return Move{move.col, row};
+        case ROTATE_270:     return Move{col, move.row};
+        case ANTI_TRANSPOSE: return Move{col, row};
+        default:             return move;
+    }
+}
+
+// Where the symmetry takes the square, the position seen through it has the stone of move there
+template <typename Geometry>
+constexpr Move transform_move(Move move, int symmetry) {
+    return transform_move(move, symmetry, Geometry::BOARD_HEIGHT, Geometry::BOARD_WIDTH);
+}
+
+// The symmetry of applying inner and then outer, found by following two squares that only the identity fixes
+constexpr std::array<std::array<int, MAX_SYMMETRIES>, MAX_SYMMETRIES> get_symmetry_products() {
+    std::array<std::array<int, MAX_SYMMETRIES>, MAX_SYMMETRIES> products{};
+    constexpr Move corner = {0, 0};
+    constexpr Move edge = {0, 1};
+
+    for (int outer = 0; outer < MAX_SYMMETRIES; outer++) {
+        for (int inner = 0; inner < MAX_SYMMETRIES; inner++) {
+            Move corner_image = transform_move(transform_move(corner, inner, 3, 3), outer, 3, 3);
+            Move edge_image = transform_move(transform_move(edge, inner, 3, 3), outer, 3, 3);
+
+            for (int symmetry = 0; symmetry < MAX_SYMMETRIES; symmetry++) {
+                if (transform_move(corner, symmetry, 3, 3) == corner_image
+                    && transform_move(edge, symmetry, 3, 3) == edge_image) {
+                    products[outer][inner] = symmetry;
+                }
+            }
+        }
+    }
+
+    return products;
+}
+
+constexpr std::array<std::array<int, MAX_SYMMETRIES>, MAX_SYMMETRIES> SYMMETRY_PRODUCTS = get_symmetry_products();
+
+constexpr int combine_symmetries(int outer, int inner) {
+    return SYMMETRY_PRODUCTS[outer][inner];
+}
+
+
+#endif //MCTS_MNK_SYMMETRY_H
@@ -0,0 +1,63 @@
+#include "thread_pool.h"
+
+ThreadPool::~ThreadPool() {
+    stop();
+}
+
+void ThreadPool::helper_loop(int thread_id, uint64_t seen_generation) {
+    while (true) {
+        generation.wait(seen_generation);
+        seen_generation = generation.load();
+
+        if (stopping) return;
+
+        job(thread_id);
+
+        if (pending.fetch_sub(1) == 1) pending.notify_all();
+    }
+}
+
+void ThreadPool::stop() {
+    if (helpers.empty()) return;
+
+    stopping = true;
+    generation++;
+    generation.notify_all();
+
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+
+    helpers.clear();
+    stopping = false;
+}
+
+void ThreadPool::resize(int threads) {
+    if (threads == size()) return;
+
+    stop();
+
+    uint64_t current_generation = generation.load();
+    for (int thread_id = 1; thread_id < threads; thread_id++) {
+        helpers.emplace_back([this, thread_id, current_generation](){
+            this->helper_loop(thread_id, current_generation);
+        });
+    }
+}
+
+void ThreadPool::start(std::function<void(int)> new_job) {
+    if (helpers.empty()) return;
+
+    job = std::move(new_job);
+    pending = static_cast<int>(helpers.size());
+
+    generation++;
+    generation.notify_all();
+}
+
+void ThreadPool::wait() {
+    int current_pending;
+    while ((current_pending = pending.load()) != 0) {
+        pending.wait(current_pending);
+    }
+}
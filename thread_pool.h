@@ -0,0 +1,46 @@
+#ifndef MCTS_MNK_THREAD_POOL_H
+#define MCTS_MNK_THREAD_POOL_H
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+/*
+ * A persistent set of helper threads. The calling thread counts as thread 0, the helpers are 1 to size() - 1.
+ * Jobs are handed off through an atomic generation counter, so starting a job costs a notify
+ * instead of a thread creation, and idle helpers sleep in atomic waits.
+ */
+class ThreadPool {
+
+private:
+    std::vector<std::thread> helpers{};
+    std::function<void(int)> job{};
+
+    std::atomic<uint64_t> generation = 0;
+    std::atomic<int> pending = 0;
+    bool stopping = false;
+
+    void helper_loop(int thread_id, uint64_t seen_generation);
+    void stop();
+
+public:
+    ThreadPool() = default;
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    inline int size() { return static_cast<int>(helpers.size()) + 1; }
+
+    void resize(int threads);
+
+    // Runs job(thread_id) on every helper thread, returns immediately
+    void start(std::function<void(int)> new_job);
+
+    // Blocks until every helper has finished the started job
+    void wait();
+};
+
+
+#endif //MCTS_MNK_THREAD_POOL_H
@@ -0,0 +1,53 @@
+#ifndef MCTS_MNK_ZOBRIST_H
+#define MCTS_MNK_ZOBRIST_H
+
+#include <cstdint>
+#include "constants.h"
+#include "random.h"
+#include "symmetry.h"
+
+constexpr uint64_t ZOBRIST_SEED = 0x5A0B815743C0FFEEULL;
+
+/*
+ * A random key for every colour on every square and one for black to move. The key of a position is the xor of the
+ * keys of its stones and, when black is to move, the side key. The tables are filled at compile time, every geometry
+ * gets its own.
+ *
+ * pieces[color][row][col][symmetry] is the key of the square the symmetry takes (row, col) to, so make_move and
+ * undo_move keep the key of the position seen through every symmetry with one xor each. The keys of a square share
+ * a cache line.
+ */
+template <typename Geometry>
+struct ZobristKeys {
+    alignas(64) uint64_t pieces[2][Geometry::BOARD_HEIGHT][Geometry::BOARD_WIDTH][Geometry::SYMMETRIES]{};
+    uint64_t side = 0;
+
+    constexpr ZobristKeys() {
+        uint64_t seed = ZOBRIST_SEED;
+
+        for (auto& color_keys : pieces) {
+            for (auto& row_keys : color_keys) {
+                for (auto& square_keys : row_keys) square_keys[IDENTITY] = Random::splitmix64(seed);
+            }
+        }
+
+        side = Random::splitmix64(seed);
+
+        for (int color = 0; color < 2; color++) {
+            for (uint16_t row = 0; row < Geometry::BOARD_HEIGHT; row++) {
+                for (uint16_t col = 0; col < Geometry::BOARD_WIDTH; col++) {
+                    for (int symmetry = 1; symmetry < Geometry::SYMMETRIES; symmetry++) {
+                        Move image = transform_move<Geometry>(Move{row, col}, symmetry);
+                        pieces[color][row][col][symmetry] = pieces[color][image.row][image.col][IDENTITY];
+                    }
+                }
+            }
+        }
+    }
+};
+
+template <typename Geometry>
+constexpr ZobristKeys<Geometry> ZOBRIST_KEYS{};
+
+
+#endif //MCTS_MNK_ZOBRIST_H